@@ -0,0 +1,57 @@
+// compares lookups in a comparator tree with the same keys in a rbt_create_u64 tree
+#include "../include/rb_tree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define N 1000000
+#define ROUNDS 5
+
+static uint64_t keys[N];
+
+int comp(void* a, void* b) {
+    uint64_t l = *(uint64_t*)a, r = *(uint64_t*)b;
+    return (l > r) - (l < r);
+}
+
+void dtor(void* value) { (void)value; }
+
+static uint64_t next_rand(uint64_t* state) {  // xorshift64
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static double lookup(rbt_tree* tree, size_t* found) {
+    clock_t start = clock();
+    for (int round = 0; round < ROUNDS; ++round)
+        for (size_t i = 0; i < N; ++i)
+            *found += rbt_iter_neq(rbt_find(tree, keys + i), rbt_end(tree));
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(void) {
+    uint64_t state = 88172645463325252ull;
+    for (size_t i = 0; i < N; ++i)
+        keys[i] = next_rand(&state);
+
+    rbt_tree* generic = rbt_create(comp);
+    rbt_tree* keyed   = rbt_create_u64(0);
+    for (size_t i = 0; i < N; ++i) {
+        rbt_insert(generic, keys + i);
+        rbt_insert(keyed, keys + i);
+    }
+
+    size_t found        = 0;
+    double generic_time = lookup(generic, &found);
+    double keyed_time   = lookup(keyed, &found);
+    printf("%d lookups in %d values (%zu found)\n", N * ROUNDS, N, found);
+    printf("rbt_create:     %.3fs\n", generic_time);
+    printf("rbt_create_u64: %.3fs (%.2fx)\n", keyed_time, generic_time / keyed_time);
+
+    rbt_destroy(generic, dtor);
+    rbt_destroy(keyed, dtor);
+    return 0;
+}
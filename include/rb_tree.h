@@ -15,6 +15,7 @@ typedef struct node_t   node_t;
 typedef struct {
     node_t*       node;
     unsigned long is_reverse;  // for reverse iterator
+    size_t        index;       // position among equal values of a multimap node, always 0 otherwise
 } rbt_iterator;
 
 typedef struct {
@@ -42,13 +43,19 @@ typedef void (*rbt_val_dtor)(void*);
 typedef int (*rbt_val_comp)(void*, void*);    // < 0 means less, == 0 means equal, > 0 means greater
 typedef void (*rbt_tree_print)(const char*);  // print tree structure
 typedef void (*rbt_val_print)(void*);         // print value
+typedef void (*rbt_val_visit)(void* value, void* ctx);
+typedef void (*rbt_val_fold)(void* acc, void* value, void* ctx);  // fold value into acc
+typedef void (*rbt_acc_combine)(void* acc, void* other, void* ctx);  // acc = acc op other
 
 rbt_tree* rbt_create(rbt_val_comp cmpr);
+rbt_tree* rbt_create_multimap(rbt_val_comp cmpr);  // equal values share one node
+rbt_tree* rbt_create_u64(size_t key_offset);       // values are ordered by the uint64_t at key_offset
+rbt_tree* rbt_create_i64(size_t key_offset);       // values are ordered by the int64_t at key_offset
 void      rbt_destroy(rbt_tree*, rbt_val_dtor dtor);
 
 rbt_insert_result_t           rbt_insert(rbt_tree*, void*);
 rbt_insert_result_t           rbt_insert_unique(rbt_tree*, void*);
-rbt_insert_or_assign_result_t rbt_insert_or_assign(rbt_tree*, void*);
+rbt_insert_or_assign_result_t rbt_insert_or_assign(rbt_tree*, void*);  // replaces the first of the equal values
 
 void* rbt_extract(rbt_tree* tree, rbt_iterator it);
 
@@ -60,7 +67,7 @@ void         rbt_clear(rbt_tree*, rbt_val_dtor dtor);
 rbt_iterator rbt_find(rbt_tree*, void*);
 void*        rbt_val_at(rbt_tree*, void*);
 void*        rbt_val_at_or(rbt_tree*, void*, void*);
-size_t       rbt_size(rbt_tree*);
+size_t       rbt_size(rbt_tree*);  // number of values, duplicates in a multimap node included
 
 rbt_iterator         rbt_lower_bound(rbt_tree*, void*);
 rbt_iterator         rbt_upper_bound(rbt_tree*, void*);
@@ -75,12 +82,40 @@ bool rbt_is_empty(rbt_tree* tree);
 
 void rbt_display(rbt_tree* tree, rbt_tree_print, rbt_val_print);
 
+// the tree must not be modified meanwhile, nthreads == 0 means one thread per online cpu, [lo, hi) is unbounded
+// on the side given NULL. Return 0 or ENOMEM.
+int rbt_parallel_for_each(rbt_tree*, rbt_val_visit fn, void* ctx, size_t nthreads);
+int rbt_parallel_for_each_range(rbt_tree*, void* lo, void* hi, rbt_val_visit fn, void* ctx, size_t nthreads);
+// acc holds the identity of combine_fn on entry and the result on return, which is the same as a sequential
+// fold whenever map_fn and combine_fn are associative
+int rbt_parallel_reduce(rbt_tree*, rbt_val_fold map_fn, rbt_acc_combine combine_fn, void* acc, size_t acc_size,
+                        void* ctx, size_t nthreads);
+int rbt_parallel_reduce_range(rbt_tree*, void* lo, void* hi, rbt_val_fold map_fn, rbt_acc_combine combine_fn,
+                              void* acc, size_t acc_size, void* ctx, size_t nthreads);
+
 rbt_iterator rbt_iter_next(rbt_iterator it);
 rbt_iterator rbt_iter_prev(rbt_iterator it);
 void*        rbt_iter_val(rbt_iterator it);
 bool         rbt_iter_eq(rbt_iterator lhs, rbt_iterator rhs);
 bool         rbt_iter_neq(rbt_iterator lhs, rbt_iterator rhs);
 
+// file backed tree keeping value_size bytes per value inline, see docs/doc.md for the durability guarantees.
+// One process at a time may open a file, the others fail with EBUSY. Values are aligned to max_align_t, and
+// pointers returned by rbt_mapped_find are valid until the next insertion, which may grow and remap the file.
+typedef struct rbt_mapped_tree rbt_mapped_tree;
+
+rbt_mapped_tree* rbt_open_mapped(const char* path, rbt_val_comp cmpr, size_t value_size);  // NULL and errno on failure
+int              rbt_close_mapped(rbt_mapped_tree*);
+int              rbt_sync(rbt_mapped_tree*);
+
+int    rbt_mapped_insert(rbt_mapped_tree*, const void* value);         // 0 for success, errno otherwise
+int    rbt_mapped_insert_unique(rbt_mapped_tree*, const void* value);  // -1 if the same value exists
+void*  rbt_mapped_find(rbt_mapped_tree*, void* key);
+size_t rbt_mapped_erase(rbt_mapped_tree*, void* key);
+size_t rbt_mapped_size(rbt_mapped_tree*);
+void   rbt_mapped_clear(rbt_mapped_tree*);
+void   rbt_mapped_for_each(rbt_mapped_tree*, rbt_val_visit fn, void* ctx);
+
 #define rbt_for_each_impl(tree, iter, ...)                                                                     \
     for (rbt_iterator iter = rbt_##__VA_ARGS__##begin(tree); rbt_iter_neq(iter, rbt_##__VA_ARGS__##end(tree)); \
          iter              = rbt_iter_next(iter))
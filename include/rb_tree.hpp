@@ -0,0 +1,394 @@
+#ifndef _RB_TREE_HPP
+#define _RB_TREE_HPP
+
+// C++ front end of rb_tree.h: values are stored inline and the comparator is a template parameter, so
+// lookups compile down to a plain loop, while linking and rebalancing go through the C core.
+
+#include "rb_tree_link.h"
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rbt {
+
+template <class T, class Compare, class Allocator>
+class tree;
+
+namespace detail {
+    template <class T>
+    struct node : rbt_link {  // links and value only, nothing of the C node's value pointer and bucket
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T*       valptr() noexcept { return std::launder(reinterpret_cast<T*>(storage)); }
+        const T* valptr() const noexcept { return std::launder(reinterpret_cast<const T*>(storage)); }
+    };
+
+    template <class T, bool Const>
+    class iterator {
+        template <class, class, class>
+        friend class ::rbt::tree;
+        friend class iterator<T, !Const>;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type        = T;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = std::conditional_t<Const, const T*, T*>;
+        using reference         = std::conditional_t<Const, const T&, T&>;
+
+        iterator() noexcept = default;
+        template <bool C = Const, class = std::enable_if_t<C>>
+        iterator(const iterator<T, false>& other) noexcept : _node(other._node) {}
+
+        reference operator*() const noexcept { return *static_cast<node<T>*>(_node)->valptr(); }
+        pointer   operator->() const noexcept { return static_cast<node<T>*>(_node)->valptr(); }
+
+        iterator& operator++() noexcept {
+            _node = rbt_link_next(_node);
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            iterator tmp = *this;
+            _node        = rbt_link_next(_node);
+            return tmp;
+        }
+        iterator& operator--() noexcept {
+            _node = rbt_link_prev(_node);
+            return *this;
+        }
+        iterator operator--(int) noexcept {
+            iterator tmp = *this;
+            _node        = rbt_link_prev(_node);
+            return tmp;
+        }
+
+        friend bool operator==(const iterator& lhs, const iterator& rhs) noexcept { return lhs._node == rhs._node; }
+        friend bool operator!=(const iterator& lhs, const iterator& rhs) noexcept { return lhs._node != rhs._node; }
+
+    private:
+        explicit iterator(rbt_link* node) noexcept : _node(node) {}
+
+        rbt_link* _node = nullptr;
+    };
+}  // namespace detail
+
+// ordered container of T, insert() keeps duplicates like rbt_insert, insert_unique() rejects them like
+// rbt_insert_unique. Iterators stay valid until the element they point to is erased.
+// The nil sentinel every leaf points to is allocated with the first element, so an empty tree owns no memory
+// and moving a tree never allocates.
+template <class T, class Compare = std::less<T>, class Allocator = std::allocator<T>>
+class tree {
+    using node_type        = detail::node<T>;
+    using alloc_traits     = std::allocator_traits<Allocator>;
+    using node_allocator   = typename alloc_traits::template rebind_alloc<node_type>;
+    using node_traits      = std::allocator_traits<node_allocator>;
+    using header_allocator = typename alloc_traits::template rebind_alloc<rbt_link>;
+    using header_traits    = std::allocator_traits<header_allocator>;
+
+public:
+    using value_type             = T;
+    using size_type              = std::size_t;
+    using difference_type        = std::ptrdiff_t;
+    using value_compare          = Compare;
+    using allocator_type         = Allocator;
+    using reference              = T&;
+    using const_reference        = const T&;
+    using pointer                = typename alloc_traits::pointer;
+    using const_pointer          = typename alloc_traits::const_pointer;
+    using iterator               = detail::iterator<T, false>;
+    using const_iterator         = detail::iterator<T, true>;
+    using reverse_iterator       = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    tree() noexcept(std::is_nothrow_default_constructible_v<Compare>
+                    && std::is_nothrow_default_constructible_v<Allocator>)
+        : tree(Compare()) {}
+    explicit tree(const Compare& comp, const Allocator& alloc = Allocator()) : _comp(comp), _alloc(alloc) {}
+    tree(const tree& other)
+        : _comp(other._comp), _alloc(node_traits::select_on_container_copy_construction(other._alloc)) {
+        try {
+            append(other.begin(), other.end());
+        }
+        catch (...) {
+            clear();
+            drop_header();
+            throw;
+        }
+    }
+    tree(tree&& other) noexcept
+        : _comp(other._comp), _alloc(std::move(other._alloc)), _header(other._header), _size(other._size) {
+        other._header = nullptr;
+        other._size   = 0;
+    }
+    ~tree() {
+        clear();
+        drop_header();
+    }
+
+    tree& operator=(const tree& other) {
+        if (this != &other) {
+            clear();
+            if constexpr (node_traits::propagate_on_container_copy_assignment::value) {
+                if (_alloc != other._alloc)
+                    drop_header();  // the sentinel belongs to the old allocator
+                _alloc = other._alloc;
+            }
+            _comp = other._comp;
+            append(other.begin(), other.end());
+        }
+        return *this;
+    }
+    // nodes can only change hands when the allocator can free them, otherwise the values are moved one by one
+    tree& operator=(tree&& other) noexcept(node_traits::propagate_on_container_move_assignment::value
+                                           || node_traits::is_always_equal::value) {
+        if (this == &other)
+            return *this;
+        clear();
+        _comp = other._comp;
+        if constexpr (!node_traits::propagate_on_container_move_assignment::value
+                      && !node_traits::is_always_equal::value)
+            if (_alloc != other._alloc) {
+                append(std::make_move_iterator(other.begin()), std::make_move_iterator(other.end()));
+                other.clear();
+                return *this;
+            }
+        drop_header();
+        if constexpr (node_traits::propagate_on_container_move_assignment::value)
+            _alloc = std::move(other._alloc);
+        _header       = other._header;
+        _size         = other._size;
+        other._header = nullptr;
+        other._size   = 0;
+        return *this;
+    }
+
+    allocator_type get_allocator() const { return allocator_type(_alloc); }
+    value_compare  value_comp() const { return _comp; }
+
+    iterator               begin() noexcept { return iterator(leftmost()); }
+    const_iterator         begin() const noexcept { return const_iterator(leftmost()); }
+    const_iterator         cbegin() const noexcept { return begin(); }
+    iterator               end() noexcept { return iterator(_header); }
+    const_iterator         end() const noexcept { return const_iterator(_header); }
+    const_iterator         cend() const noexcept { return end(); }
+    reverse_iterator       rbegin() noexcept { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const noexcept { return const_reverse_iterator(end()); }
+    reverse_iterator       rend() noexcept { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const noexcept { return const_reverse_iterator(begin()); }
+
+    bool      empty() const noexcept { return _size == 0; }
+    size_type size() const noexcept { return _size; }
+    size_type max_size() const noexcept { return node_traits::max_size(_alloc); }
+
+    iterator insert(const T& value) { return emplace(value); }
+    iterator insert(T&& value) { return emplace(std::move(value)); }
+    template <class InputIt>
+    void insert(InputIt first, InputIt last) {
+        for (; first != last; ++first)
+            emplace(*first);
+    }
+    std::pair<iterator, bool> insert_unique(const T& value) { return emplace_unique(value); }
+    std::pair<iterator, bool> insert_unique(T&& value) { return emplace_unique(std::move(value)); }
+
+    template <class... Args>
+    iterator emplace(Args&&... args) {
+        make_header();
+        node_type* node   = create_node(std::forward<Args>(args)...);
+        rbt_link*  parent = _header;
+        bool       left   = true;
+        for (rbt_link* curr = _header->parent; curr != _header; curr = left ? curr->left : curr->right) {
+            parent = curr;
+            left   = _comp(*node->valptr(), value_of(curr));
+        }
+        return link(parent, left, node);
+    }
+
+    template <class... Args>
+    std::pair<iterator, bool> emplace_unique(Args&&... args) {
+        make_header();
+        node_type* node   = create_node(std::forward<Args>(args)...);
+        rbt_link*  parent = _header;
+        bool       left   = true;
+        for (rbt_link* curr = _header->parent; curr != _header; curr = left ? curr->left : curr->right) {
+            parent = curr;
+            left   = _comp(*node->valptr(), value_of(curr));
+        }
+        rbt_link* prev = parent;  // the only candidate for an equal value
+        if (left) {
+            if (parent == _header->left)
+                return { link(parent, left, node), true };
+            prev = rbt_link_prev(parent);
+        }
+        if (_comp(value_of(prev), *node->valptr()))
+            return { link(parent, left, node), true };
+        drop_node(node);
+        return { iterator(prev), false };
+    }
+
+    iterator erase(const_iterator pos) {
+        rbt_link* next = rbt_link_next(pos._node);
+        rbt_link_erase(_header, pos._node);
+        drop_node(static_cast<node_type*>(pos._node));
+        --_size;
+        return iterator(next);
+    }
+    iterator erase(const_iterator first, const_iterator last) {
+        if (first == begin() && last == end())
+            clear();
+        else
+            while (first != last)
+                first = erase(first);
+        return iterator(last._node);
+    }
+    size_type erase(const T& key) {
+        auto      range = equal_range(key);
+        size_type n     = 0;
+        for (; range.first != range.second; ++n)
+            range.first = erase(range.first);
+        return n;
+    }
+
+    void clear() noexcept {
+        if (_header) {
+            destroy(_header->parent);
+            rbt_link_init(_header);
+        }
+        _size = 0;
+    }
+
+    void swap(tree& other) noexcept {
+        using std::swap;
+        swap(_comp, other._comp);
+        if constexpr (node_traits::propagate_on_container_swap::value)
+            swap(_alloc, other._alloc);
+        swap(_header, other._header);
+        swap(_size, other._size);
+    }
+    friend void swap(tree& lhs, tree& rhs) noexcept { lhs.swap(rhs); }
+
+    iterator       find(const T& key) { return iterator(find_node(key)); }
+    const_iterator find(const T& key) const { return const_iterator(find_node(key)); }
+    bool           contains(const T& key) const { return find_node(key) != _header; }
+    size_type      count(const T& key) const {
+        auto range = equal_range(key);
+        return static_cast<size_type>(std::distance(range.first, range.second));
+    }
+
+    iterator       lower_bound(const T& key) { return iterator(lower_bound_node(key)); }
+    const_iterator lower_bound(const T& key) const { return const_iterator(lower_bound_node(key)); }
+    iterator       upper_bound(const T& key) { return iterator(upper_bound_node(key)); }
+    const_iterator upper_bound(const T& key) const { return const_iterator(upper_bound_node(key)); }
+
+    std::pair<iterator, iterator> equal_range(const T& key) {
+        return { iterator(lower_bound_node(key)), iterator(upper_bound_node(key)) };
+    }
+    std::pair<const_iterator, const_iterator> equal_range(const T& key) const {
+        return { const_iterator(lower_bound_node(key)), const_iterator(upper_bound_node(key)) };
+    }
+
+private:
+    static const T& value_of(const rbt_link* node) noexcept { return *static_cast<const node_type*>(node)->valptr(); }
+
+    rbt_link* root() const noexcept { return _header ? _header->parent : nullptr; }
+    rbt_link* leftmost() const noexcept { return _header ? _header->left : nullptr; }
+
+    rbt_link* lower_bound_node(const T& key) const {
+        rbt_link* res = _header;
+        for (rbt_link* curr = root(); curr != _header;)
+            if (!_comp(value_of(curr), key)) {  // curr.key >= key
+                res  = curr;
+                curr = curr->left;
+            }
+            else
+                curr = curr->right;
+        return res;
+    }
+
+    rbt_link* upper_bound_node(const T& key) const {
+        rbt_link* res = _header;
+        for (rbt_link* curr = root(); curr != _header;)
+            if (_comp(key, value_of(curr))) {  // curr.key > key
+                res  = curr;
+                curr = curr->left;
+            }
+            else
+                curr = curr->right;
+        return res;
+    }
+
+    rbt_link* find_node(const T& key) const {
+        rbt_link* res = lower_bound_node(key);
+        return (res == _header || _comp(key, value_of(res))) ? _header : res;
+    }
+
+    template <class... Args>
+    node_type* create_node(Args&&... args) {
+        node_type* node = std::addressof(*node_traits::allocate(_alloc, 1));
+        ::new (static_cast<void*>(node)) node_type;
+        try {
+            node_traits::construct(_alloc, reinterpret_cast<T*>(node->storage), std::forward<Args>(args)...);
+        }
+        catch (...) {
+            node_traits::deallocate(_alloc, node, 1);
+            throw;
+        }
+        return node;
+    }
+
+    void drop_node(node_type* node) noexcept {
+        node_traits::destroy(_alloc, node->valptr());
+        node_traits::deallocate(_alloc, node, 1);
+    }
+
+    iterator link(rbt_link* parent, bool left, node_type* node) noexcept {
+        rbt_link_insert(_header, parent, left, node);
+        ++_size;
+        return iterator(node);
+    }
+
+    template <class It>
+    void append(It first, It last) {  // [first, last) must be sorted and not less than the current values
+        if (first != last)
+            make_header();
+        for (; first != last; ++first)
+            link(_header->right, _header->right == _header, create_node(*first));
+    }
+
+    void destroy(rbt_link* node) noexcept {
+        while (node != _header) {  // recurse on the right, loop on the left
+            destroy(node->right);
+            rbt_link* left = node->left;
+            drop_node(static_cast<node_type*>(node));
+            node = left;
+        }
+    }
+
+    void make_header() {
+        if (_header == nullptr) {
+            header_allocator alloc(_alloc);
+            _header = std::addressof(*header_traits::allocate(alloc, 1));
+            rbt_link_init(_header);
+        }
+    }
+
+    void drop_header() noexcept {
+        if (_header) {
+            header_allocator alloc(_alloc);
+            header_traits::deallocate(alloc, _header, 1);
+            _header = nullptr;
+        }
+    }
+
+    Compare        _comp;
+    node_allocator _alloc;
+    rbt_link*      _header = nullptr;  // allocated by the first insertion
+    size_type      _size   = 0;
+};
+
+}  // namespace rbt
+
+#endif /* _RB_TREE_HPP */
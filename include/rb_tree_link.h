@@ -0,0 +1,32 @@
+#ifndef _RB_TREE_LINK_H
+#define _RB_TREE_LINK_H
+
+// internal header shared by src/rb_tree.c and rb_tree.hpp, not part of the C API.
+// Only the links take part in rebalancing, so each front end puts its own payload behind them.
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rbt_link {
+    unsigned long    color;
+    struct rbt_link* left;
+    struct rbt_link* right;
+    struct rbt_link* parent;
+} rbt_link;
+
+// `header` is the nil sentinel of a tree, which also holds the root (parent), the leftmost (left) and
+// the rightmost (right) node
+void      rbt_link_init(rbt_link* header);
+void      rbt_link_insert(rbt_link* header, rbt_link* parent, bool left, rbt_link* node);  // link and rebalance
+void      rbt_link_erase(rbt_link* header, rbt_link* node);  // unlink and rebalance, memory is left to the caller
+rbt_link* rbt_link_next(rbt_link* node);
+rbt_link* rbt_link_prev(rbt_link* node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RB_TREE_LINK_H */
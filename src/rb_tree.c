@@ -1,8 +1,14 @@
+#define _POSIX_C_SOURCE 200809L
 #include "../include/rb_tree.h"
+#include "../include/rb_tree_link.h"
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define RED 0
 #define BLACK 1
@@ -16,99 +22,206 @@
 #define IS_RIGHT(node) ((node) == (node)->parent->right)
 #define IS_ACTUAL_ROOT(node) ((node) == (node)->parent->parent)
 
+// the bits above nil tell the layout of a node, iterators have no tree to ask
+#define MULTI 4  // a multi_node_t
+#define KEYED 8  // a keyed_node_t
+
 #define MAX_DEPTH 128 // for display
+#define MAX_HEIGHT 128 // for traversal stacks, a red-black tree is never higher than 2 * log2(size + 1)
+#define SPANS_PER_THREAD 128 // spans are claimed one at a time, so the largest one bounds the imbalance
+#define MAX_SPLIT_DEPTH 16
+
+#define NODE(link) ((node_t*)(link))
+#define LINK(node) (&(node)->link)
+#define BUCKET_OF(link) (((multi_node_t*)(link))->bucket)
+#define KEY_OF(link) (((keyed_node_t*)(link))->key)
+// comparator trees are never keyed, so their searches read NODE(link)->value directly
+#define VALUE_OF(link) (*((link)->color & KEYED ? &((keyed_node_t*)(link))->value : &NODE(link)->value))
+#define SIGN_BIT ((uint64_t)1 << 63)
+
+typedef struct rbt_bucket {  // values equal to node->value in multimap mode, in insertion order
+    size_t size;
+    size_t capacity;
+    void*  values[];
+} bucket_t;
 
 typedef struct node_t {
-    void*          value;
-    unsigned long  color;
-    struct node_t* left;
-    struct node_t* right;
-    struct node_t* parent;
+    rbt_link link;  // first, so a link converts back to its node
+    void*    value;
 } node_t;
 
+typedef struct {  // node of the trees made by rbt_create_multimap
+    node_t    node;
+    bucket_t* bucket;  // NULL unless the node holds duplicates
+} multi_node_t;
+
+typedef struct {  // node of the trees made by rbt_create_u64 / rbt_create_i64, never multimaps
+    rbt_link link;
+    uint64_t key;  // next to the links, so a search step reads a single cache line most of the time. Signed
+                   // keys are stored with the sign bit flipped, so both compare as unsigned
+    void*    value;
+} keyed_node_t;
+
 enum inspos { Left, Right };
 
+enum keytype { Comparator, Unsigned64, Signed64 };
+
 typedef struct {
-    node_t*     parent;
+    rbt_link*   parent;
     enum inspos pos;
 } ins_pack_t;
 
 typedef struct {
     ins_pack_t pack;
-    node_t*    curr;
+    rbt_link*  curr;
 } find_result_t;
 
 typedef struct {  // for equal range
-    node_t* first;
-    node_t* second;
+    rbt_link* first;
+    rbt_link* second;
 } nodeptr_pair_t;
 
+typedef struct {  // a piece of the in-order sequence handed to a parallel worker
+    rbt_link* node;
+    bool      whole;  // the entire subtree, otherwise the node alone
+} span_t;
+
+typedef struct {  // shared by the workers of one parallel call
+    rbt_tree*     tree;
+    void*         lo;
+    void*         hi;
+    rbt_val_visit visit;
+    rbt_val_fold  fold;  // used instead of visit when reducing
+    void*         ctx;
+    span_t*       spans;
+    size_t        nspans;
+    atomic_size_t next;  // the first span nobody has claimed yet
+    char*         accs;  // an accumulator per span when reducing
+    size_t        acc_size;
+} job_t;
+
 typedef struct rbt_tree {
     node_t       root;
     size_t       size;
     rbt_val_comp comp;
+    bool         multi;
+    enum keytype keytype;
+    size_t       key_offset;  // where the integer key lives inside a value
+    unsigned int layout;      // or'ed into the color of every node
 } rbt_tree;
 
 // basic operation
-static node_t* leftmost(node_t* node);
-static node_t* rightmost(node_t* node);
-static node_t* inorder_predecessor(node_t* node);
-static node_t* inorder_successor(node_t* node);
-static void    set_color(node_t* node, int color);
+static rbt_link* leftmost(rbt_link* node);
+static rbt_link* rightmost(rbt_link* node);
+static rbt_link* inorder_predecessor(rbt_link* node);
+static rbt_link* inorder_successor(rbt_link* node);
+static void      set_color(rbt_link* node, int color);
+
+// bucket operation
+static size_t value_count(rbt_link* link);
+static void*  value_at(rbt_link* link, size_t index);
+static int    bucket_push(rbt_link* link, void* value);
+static void*  bucket_remove(rbt_link* link, size_t index);
+static void   bucket_cut(rbt_link* link, size_t first, size_t last);
+static void   destroy_values(rbt_link* link, rbt_val_dtor dtor);
 
 // iterator operation
-static node_t*      incr(node_t* node);
-static node_t*      decr(node_t* node);
-static rbt_iterator make_iter(node_t* node);
-static rbt_iterator make_riter(node_t* node);
+static rbt_link*    incr(rbt_link* node);
+static rbt_link*    decr(rbt_link* node);
+static rbt_iterator make_iter(rbt_link* node);
+static rbt_iterator make_riter(rbt_link* node);
+static rbt_iterator next_pos(rbt_iterator it);
+static rbt_iterator prev_pos(rbt_iterator it);
 
 // tree implementation
 static find_result_t  lower_bound(rbt_tree* tree, void*);
 static find_result_t  upper_bound(rbt_tree* tree, void*);
 static nodeptr_pair_t equal_range(rbt_tree* tree, void*);
-static node_t*        create_node(rbt_tree* tree, void*);
-static node_t*        insert_at(rbt_tree* tree, ins_pack_t pack, node_t* new_node);
-static void           take_node(node_t* node, node_t* suc);
-static node_t*        extract_node(rbt_tree* tree, node_t* node);  // extract node without free mem
-static void           display(rbt_tree* tree, bool* visited, node_t* node, size_t size, bool position, rbt_tree_print tprint,
-                              rbt_val_print vprint);
+static uint64_t       extract_key(rbt_tree* tree, void*);
+static int            compare(rbt_tree* tree, rbt_link* node, void*);  // node.key <=> key
+static find_result_t  lower_bound_key(rbt_tree* tree, uint64_t key);
+static find_result_t  upper_bound_key(rbt_tree* tree, uint64_t key);
+static rbt_link*      create_node(rbt_tree* tree, void*);
+static rbt_link*      insert_at(rbt_tree* tree, ins_pack_t pack, rbt_link* new_node);
+static void           erase_node(rbt_tree* tree, rbt_link* node, rbt_val_dtor dtor);
+static rbt_insert_result_t insert_multi(rbt_tree* tree, void*);
+static void           extract_node(rbt_link* root, rbt_link* node);  // extract node without free mem
+static void           display(rbt_tree* tree, bool* visited, rbt_link* node, size_t size, bool position,
+                              rbt_tree_print tprint, rbt_val_print vprint);
+
+// parallel traversal
+static int    parallel(job_t* job, void* acc, rbt_acc_combine combine, size_t nthreads);
+static size_t split_depth(size_t nthreads);
+static void   split(rbt_tree* tree, void* lo, void* hi, rbt_link* node, size_t depth, span_t* spans, size_t* n);
+static void*  work(void* job);
+static void   walk(job_t* job, rbt_link* node, void* acc);
+static void   visit_values(job_t* job, rbt_link* node, void* acc);
 
 // rb tree implementation
-static void    insert_fixup(rbt_tree* tree, node_t* new_node);
-static void    erase_fixup(rbt_tree* tree, node_t* node);
-static node_t* rotate_left(rbt_tree* tree, node_t* node);
-static node_t* rotate_right(rbt_tree* tree, node_t* node);
+static void      insert_fixup(rbt_link* root, rbt_link* new_node);
+static void      erase_fixup(rbt_link* root, rbt_link* node, rbt_link* parent);
+static rbt_link* rotate_left(rbt_link* root, rbt_link* node);
+static rbt_link* rotate_right(rbt_link* root, rbt_link* node);
 
-static void destroy(node_t* node, rbt_val_dtor dtor) {
+static void destroy(rbt_link* node, rbt_val_dtor dtor) {
     if (!IS_NIL(node)) {
-        destroy(node->left, dtor);
-        destroy(node->right, dtor);
-        dtor(node->value);
+        rbt_link* left  = node->left;
+        rbt_link* right = node->right;
+        destroy_values(node, dtor);
         free(node);
+        destroy(left, dtor);
+        destroy(right, dtor);
     }
 }
 
 rbt_tree* rbt_create(rbt_val_comp comp) {
     rbt_tree* tree = (rbt_tree*)malloc(sizeof(rbt_tree));
     if (tree) {
-        tree->comp       = comp;
-        tree->size       = 0;
-        tree->root.value = NULL;
-        tree->root.color = 2;  // is nil and red
-        tree->root.left = tree->root.right = tree->root.parent = &tree->root;
+        tree->comp        = comp;
+        tree->size        = 0;
+        tree->multi       = false;
+        tree->keytype     = Comparator;
+        tree->key_offset  = 0;
+        tree->layout      = 0;
+        tree->root.value  = NULL;
+        rbt_link_init(&tree->root.link);
+    }
+    return tree;
+}
+
+rbt_tree* rbt_create_multimap(rbt_val_comp comp) {
+    rbt_tree* tree = rbt_create(comp);
+    if (tree) {
+        tree->multi  = true;
+        tree->layout = MULTI;
+    }
+    return tree;
+}
+
+static rbt_tree* create_keyed(enum keytype keytype, size_t key_offset) {
+    rbt_tree* tree = rbt_create(NULL);
+    if (tree) {
+        tree->keytype    = keytype;
+        tree->key_offset = key_offset;
+        tree->layout     = KEYED;
     }
     return tree;
 }
 
+rbt_tree* rbt_create_u64(size_t key_offset) { return create_keyed(Unsigned64, key_offset); }
+rbt_tree* rbt_create_i64(size_t key_offset) { return create_keyed(Signed64, key_offset); }
+
 void rbt_destroy(rbt_tree* tree, rbt_val_dtor dtor) {
     rbt_clear(tree, dtor);
     free(tree);
 }
 
 rbt_insert_result_t rbt_insert(rbt_tree* tree, void* value) {
+    if (tree->multi)
+        return insert_multi(tree, value);
     find_result_t res      = upper_bound(tree, value);
     int           ret      = ENOMEM;
-    node_t*       new_node = create_node(tree, value);
+    rbt_link*     new_node = create_node(tree, value);
     if (new_node) {
         res.curr = insert_at(tree, res.pack, new_node);
         ret      = 0;
@@ -119,8 +232,8 @@ rbt_insert_result_t rbt_insert(rbt_tree* tree, void* value) {
 rbt_insert_result_t rbt_insert_unique(rbt_tree* tree, void* value) {
     find_result_t res = lower_bound(tree, value);
     int           ret = -1;
-    if (IS_NIL(res.curr) || tree->comp(res.curr->value, value) != 0) {
-        node_t* new_node = create_node(tree, value);
+    if (IS_NIL(res.curr) || compare(tree, res.curr, value) != 0) {
+        rbt_link* new_node = create_node(tree, value);
         if (new_node == NULL)
             ret = ENOMEM;
         else {
@@ -135,8 +248,8 @@ rbt_insert_or_assign_result_t rbt_insert_or_assign(rbt_tree* tree, void* value)
     find_result_t res = lower_bound(tree, value);
     int           ret = -1;
     void*         old = NULL;
-    if (IS_NIL(res.curr) || tree->comp(res.curr->value, value) != 0) {
-        node_t* new_node = create_node(tree, value);
+    if (IS_NIL(res.curr) || compare(tree, res.curr, value) != 0) {
+        rbt_link* new_node = create_node(tree, value);
         if (new_node == NULL)
             ret = ENOMEM;
         else {
@@ -145,17 +258,21 @@ rbt_insert_or_assign_result_t rbt_insert_or_assign(rbt_tree* tree, void* value)
         }
     }
     else {
-        old             = res.curr->value;
-        res.curr->value = value;
+        old                = VALUE_OF(res.curr);
+        VALUE_OF(res.curr) = value;
     }
     return (rbt_insert_or_assign_result_t){ .pos = make_iter(res.curr), .err = ret, .old = old };
 }
 
 void* rbt_extract(rbt_tree* tree, rbt_iterator position) {
-    node_t* curr  = position.node;
-    void*   value = curr->value;  // the value dummy root is also NULL
+    rbt_link* curr = LINK(position.node);
+    if (value_count(curr) > 1) {
+        --tree->size;
+        return bucket_remove(curr, position.index);
+    }
+    void* value = VALUE_OF(curr);  // the value dummy root is also NULL
     if (!IS_NIL(curr)) {
-        erase_fixup(tree, extract_node(tree, curr));
+        extract_node(&tree->root.link, curr);
         free(curr);
         --tree->size;
     }
@@ -166,9 +283,10 @@ size_t rbt_erase(rbt_tree* tree, void* value, rbt_val_dtor dtor) {
     nodeptr_pair_t res = equal_range(tree, value);
     size_t         n   = 0;
 
-    for (; res.first != res.second; ++n) {
-        node_t* suc = inorder_successor(res.first);
-        rbt_erase_at(tree, make_iter(res.first), dtor);
+    while (res.first != res.second) {
+        rbt_link* suc = inorder_successor(res.first);
+        n += value_count(res.first);
+        erase_node(tree, res.first, dtor);
         res.first = suc;
     }
 
@@ -176,51 +294,68 @@ size_t rbt_erase(rbt_tree* tree, void* value, rbt_val_dtor dtor) {
 }
 
 rbt_iterator rbt_erase_at(rbt_tree* tree, rbt_iterator position, rbt_val_dtor dtor) {
-    node_t* curr = position.node;
+    rbt_link* curr = LINK(position.node);
     if (IS_NIL(curr))
         return rbt_end(tree);
-    node_t* suc = inorder_successor(curr);
-    dtor(curr->value);
-    erase_fixup(tree, extract_node(tree, curr));
-    free(curr);
-    --tree->size;
+    if (value_count(curr) > 1) {  // only drop the value, the node stays
+        dtor(bucket_remove(curr, position.index));
+        --tree->size;
+        return position.index < value_count(curr) ? (rbt_iterator){ .node = NODE(curr), .index = position.index }
+                                                   : make_iter(inorder_successor(curr));
+    }
+    rbt_link* suc = inorder_successor(curr);
+    erase_node(tree, curr, dtor);
     return make_iter(suc);
 }
 
 rbt_iterator rbt_erase_range(rbt_tree* tree, rbt_iterator first, rbt_iterator last, rbt_val_dtor dtor) {
-    if (rbt_iter_eq(first, rbt_begin(tree)) && rbt_iter_eq(last, rbt_end(tree)))
+    if (rbt_iter_eq(first, rbt_begin(tree)) && rbt_iter_eq(last, rbt_end(tree))) {
         rbt_clear(tree, dtor);
-    else {
-        for (; rbt_iter_neq(first, last); first = rbt_iter_next(first))
-            rbt_erase_at(tree, first, dtor);
-        return make_iter(first.node);
+        return rbt_begin(tree);
+    }
+    while (rbt_iter_neq(first, last)) {
+        rbt_link* curr  = LINK(first.node);
+        size_t    count = value_count(curr);
+        size_t    end   = curr == LINK(last.node) ? last.index : count;
+        if (first.index == 0 && end == count) {  // the whole node goes
+            rbt_link* suc = inorder_successor(curr);
+            erase_node(tree, curr, dtor);
+            first = make_iter(suc);
+            continue;
+        }
+        for (size_t i = first.index; i < end; ++i)
+            dtor(value_at(curr, i));
+        bucket_cut(curr, first.index, end);
+        tree->size -= end - first.index;
+        if (end < count)  // last pointed into this node, its values moved down onto first
+            return first;
+        first = make_iter(inorder_successor(curr));
     }
-    return rbt_begin(tree);
+    return first;
 }
 
 void rbt_clear(rbt_tree* tree, rbt_val_dtor dtor) {
-    destroy(tree->root.parent, dtor);
+    destroy(tree->root.link.parent, dtor);
     tree->size      = 0;
-    tree->comp      = NULL;
-    tree->root.left = tree->root.right = tree->root.parent = &tree->root;
+    tree->root.link.left = tree->root.link.right = tree->root.link.parent = &tree->root.link;
 }
 
 rbt_iterator rbt_find(rbt_tree* tree, void* key) {
     find_result_t res = lower_bound(tree, key);
-    return (IS_NIL(res.curr) || tree->comp(key, res.curr->value) != 0) ? rbt_end(tree) : make_iter(res.curr);
+    return (IS_NIL(res.curr) || compare(tree, res.curr, key) != 0) ? rbt_end(tree) : make_iter(res.curr);
 }
 
 void* rbt_val_at(rbt_tree* tree, void* value) {
     rbt_iterator res = rbt_find(tree, value);
     assert(res.node != &tree->root);
-    return res.node->value;
+    return VALUE_OF(LINK(res.node));
 }
 
 void* rbt_val_at_or(rbt_tree* tree, void* value, void* default_val) {
     rbt_iterator res = rbt_find(tree, value);
     if (res.node == &tree->root)
         return default_val;
-    return res.node->value;
+    return VALUE_OF(LINK(res.node));
 }
 
 size_t rbt_size(rbt_tree* tree) { return tree->size; }
@@ -228,7 +363,27 @@ size_t rbt_size(rbt_tree* tree) { return tree->size; }
 void rbt_display(rbt_tree* tree, rbt_tree_print tprint, rbt_val_print vprint) {
     bool visited[MAX_DEPTH];
     memset(visited, 0, sizeof(visited));
-    display(tree, visited, tree->root.parent, 0, 0, tprint, vprint);
+    display(tree, visited, tree->root.link.parent, 0, 0, tprint, vprint);
+}
+
+int rbt_parallel_for_each(rbt_tree* tree, rbt_val_visit fn, void* ctx, size_t nthreads) {
+    return rbt_parallel_for_each_range(tree, NULL, NULL, fn, ctx, nthreads);
+}
+
+int rbt_parallel_for_each_range(rbt_tree* tree, void* lo, void* hi, rbt_val_visit fn, void* ctx, size_t nthreads) {
+    job_t job = { .tree = tree, .lo = lo, .hi = hi, .visit = fn, .ctx = ctx };
+    return parallel(&job, NULL, NULL, nthreads);
+}
+
+int rbt_parallel_reduce(rbt_tree* tree, rbt_val_fold map_fn, rbt_acc_combine combine_fn, void* acc, size_t acc_size,
+                        void* ctx, size_t nthreads) {
+    return rbt_parallel_reduce_range(tree, NULL, NULL, map_fn, combine_fn, acc, acc_size, ctx, nthreads);
+}
+
+int rbt_parallel_reduce_range(rbt_tree* tree, void* lo, void* hi, rbt_val_fold map_fn, rbt_acc_combine combine_fn,
+                              void* acc, size_t acc_size, void* ctx, size_t nthreads) {
+    job_t job = { .tree = tree, .lo = lo, .hi = hi, .fold = map_fn, .ctx = ctx, .acc_size = acc_size };
+    return parallel(&job, acc, combine_fn, nthreads);
 }
 
 rbt_iterator rbt_lower_bound(rbt_tree* tree, void* key) { return make_iter(lower_bound(tree, key).curr); }
@@ -240,46 +395,72 @@ rbt_eqrange_result_t rbt_eqaul_range(rbt_tree* tree, void* key) {
     return (rbt_eqrange_result_t){ make_iter(res.first), make_iter(res.second) };
 }
 
-rbt_iterator rbt_begin(rbt_tree* tree) { return make_iter(tree->root.left); }
-rbt_iterator rbt_end(rbt_tree* tree) { return make_iter(&tree->root); }
-rbt_iterator rbt_rbegin(rbt_tree* tree) { return make_riter(&tree->root); }
-rbt_iterator rbt_rend(rbt_tree* tree) { return make_riter(tree->root.left); }
+rbt_iterator rbt_begin(rbt_tree* tree) { return make_iter(tree->root.link.left); }
+rbt_iterator rbt_end(rbt_tree* tree) { return make_iter(&tree->root.link); }
+rbt_iterator rbt_rbegin(rbt_tree* tree) { return make_riter(&tree->root.link); }
+rbt_iterator rbt_rend(rbt_tree* tree) { return make_riter(tree->root.link.left); }
 
 bool rbt_is_empty(rbt_tree* tree) { return tree->size == 0; }
 
-rbt_iterator rbt_iter_next(rbt_iterator it) {
-    return (rbt_iterator){ .is_reverse = it.is_reverse, .node = it.is_reverse ? decr(it.node) : incr(it.node) };
-}
-rbt_iterator rbt_iter_prev(rbt_iterator it) {
-    return (rbt_iterator){ .is_reverse = it.is_reverse, .node = it.is_reverse ? incr(it.node) : decr(it.node) };
-}
+rbt_iterator rbt_iter_next(rbt_iterator it) { return it.is_reverse ? prev_pos(it) : next_pos(it); }
+rbt_iterator rbt_iter_prev(rbt_iterator it) { return it.is_reverse ? next_pos(it) : prev_pos(it); }
 void* rbt_iter_val(rbt_iterator it) {
     if (it.is_reverse)
-        return decr(it.node)->value;
-    return it.node->value;
+        it = prev_pos(it);
+    return value_at(LINK(it.node), it.index);
 }
 bool rbt_iter_eq(rbt_iterator lhs, rbt_iterator rhs) {
     assert(lhs.is_reverse == rhs.is_reverse);
-    return lhs.node == rhs.node;
+    return lhs.node == rhs.node && lhs.index == rhs.index;
 }
 bool rbt_iter_neq(rbt_iterator lhs, rbt_iterator rhs) { return !rbt_iter_eq(lhs, rhs); }
 
-static node_t* leftmost(node_t* node) {
+void rbt_link_init(rbt_link* header) {
+    header->color = 3;  // is nil and black
+    header->left = header->right = header->parent = header;
+}
+
+void rbt_link_insert(rbt_link* header, rbt_link* parent, bool left, rbt_link* node) {
+    node->color  = RED;
+    node->left   = node->right = header;
+    node->parent = parent;
+    if (parent == header)
+        header->parent = header->left = header->right = node;
+    else {
+        if (left) {
+            parent->left = node;
+            if (parent == header->left)
+                header->left = node;
+        }
+        else {
+            parent->right = node;
+            if (parent == header->right)
+                header->right = node;
+        }
+    }
+    insert_fixup(header, node);
+}
+
+void      rbt_link_erase(rbt_link* header, rbt_link* node) { extract_node(header, node); }
+rbt_link* rbt_link_next(rbt_link* node) { return incr(node); }
+rbt_link* rbt_link_prev(rbt_link* node) { return decr(node); }
+
+static rbt_link* leftmost(rbt_link* node) {
     while (!IS_NIL(node->left))
         node = node->left;
     return node;
 }
 
-static node_t* rightmost(node_t* node) {
+static rbt_link* rightmost(rbt_link* node) {
     while (!IS_NIL(node->right))
         node = node->right;
     return node;
 }
 
-static node_t* inorder_predecessor(node_t* node) {
+static rbt_link* inorder_predecessor(rbt_link* node) {
     if (!IS_NIL(node->left))
         return rightmost(node->left);
-    node_t* parent = node->parent;
+    rbt_link* parent = node->parent;
     while (!IS_NIL(parent) && IS_LEFT(node)) {
         node   = parent;
         parent = node->parent;
@@ -289,7 +470,7 @@ static node_t* inorder_predecessor(node_t* node) {
     return node;
 }
 
-static node_t* inorder_successor(node_t* node) {
+static rbt_link* inorder_successor(rbt_link* node) {
     if (!IS_NIL(node->right))
         return leftmost(node->right);
     while (!IS_NIL(node->parent) && IS_RIGHT(node))
@@ -297,25 +478,107 @@ static node_t* inorder_successor(node_t* node) {
     return node->parent;
 }
 
-static void set_color(node_t* node, int color) {
+static void set_color(rbt_link* node, int color) {
     if (color == RED)
         node->color &= ~1;
     else
         node->color |= BLACK;
 }
 
-static node_t* incr(node_t* node) { return inorder_successor(node); }
+static size_t value_count(rbt_link* link) {
+    return (link->color & MULTI) && BUCKET_OF(link) ? BUCKET_OF(link)->size + 1 : 1;
+}
+
+static void* value_at(rbt_link* link, size_t index) {
+    return index == 0 ? VALUE_OF(link) : BUCKET_OF(link)->values[index - 1];
+}
+
+static int bucket_push(rbt_link* link, void* value) {
+    multi_node_t* node   = (multi_node_t*)link;
+    bucket_t*     bucket = node->bucket;
+    if (bucket == NULL || bucket->size == bucket->capacity) {
+        size_t capacity = bucket ? bucket->capacity * 2 : 4;
+        bucket          = (bucket_t*)realloc(bucket, sizeof(bucket_t) + capacity * sizeof(void*));
+        if (bucket == NULL)
+            return ENOMEM;
+        if (node->bucket == NULL)
+            bucket->size = 0;
+        bucket->capacity = capacity;
+        node->bucket     = bucket;
+    }
+    bucket->values[bucket->size++] = value;
+    return 0;
+}
+
+static void* bucket_remove(rbt_link* link, size_t index) {
+    void* value = value_at(link, index);
+    bucket_cut(link, index, index + 1);
+    return value;
+}
+
+// drops the values at [first, last) from a node keeping at least one of them
+static void bucket_cut(rbt_link* link, size_t first, size_t last) {
+    multi_node_t* node   = (multi_node_t*)link;
+    bucket_t*     bucket = node->bucket;
+    if (first == 0) {  // the first value left becomes the key holder
+        node->node.value = bucket->values[last - 1];
+        ++last;
+    }
+    else
+        --first;
+    --last;  // [first, last) indexes bucket->values from here on
+    memmove(bucket->values + first, bucket->values + last, (bucket->size - last) * sizeof(void*));
+    bucket->size -= last - first;
+    if (bucket->size == 0) {
+        free(bucket);
+        node->bucket = NULL;
+    }
+}
+
+static void destroy_values(rbt_link* link, rbt_val_dtor dtor) {
+    bucket_t* bucket = link->color & MULTI ? BUCKET_OF(link) : NULL;
+    dtor(VALUE_OF(link));
+    if (bucket) {
+        for (size_t i = 0; i < bucket->size; ++i)
+            dtor(bucket->values[i]);
+        free(bucket);
+    }
+}
+
+static rbt_link* incr(rbt_link* node) { return inorder_successor(node); }
 
-static node_t*      decr(node_t* node) { return IS_NIL(node) ? node->right : inorder_predecessor(node); }
-static rbt_iterator make_iter(node_t* node) { return (rbt_iterator){ .node = node, .is_reverse = false }; }
-static rbt_iterator make_riter(node_t* node) { return (rbt_iterator){ .node = node, .is_reverse = true }; }
+static rbt_link*    decr(rbt_link* node) { return IS_NIL(node) ? node->right : inorder_predecessor(node); }
+static rbt_iterator make_iter(rbt_link* node) { return (rbt_iterator){ .node = NODE(node), .is_reverse = false }; }
+static rbt_iterator make_riter(rbt_link* node) { return (rbt_iterator){ .node = NODE(node), .is_reverse = true }; }
+
+static rbt_iterator next_pos(rbt_iterator it) {
+    if (it.index + 1 < value_count(LINK(it.node)))
+        ++it.index;
+    else {
+        it.node  = NODE(incr(LINK(it.node)));
+        it.index = 0;
+    }
+    return it;
+}
+
+static rbt_iterator prev_pos(rbt_iterator it) {
+    if (it.index > 0)
+        --it.index;
+    else {
+        it.node  = NODE(decr(LINK(it.node)));
+        it.index = value_count(LINK(it.node)) - 1;
+    }
+    return it;
+}
 
 static find_result_t lower_bound(rbt_tree* tree, void* key) {
-    node_t*       curr = tree->root.parent;
-    find_result_t res  = { .pack = { .parent = tree->root.parent }, .curr = &tree->root };
+    if (tree->keytype != Comparator)
+        return lower_bound_key(tree, extract_key(tree, key));
+    rbt_link*     curr = tree->root.link.parent;
+    find_result_t res  = { .pack = { .parent = tree->root.link.parent }, .curr = &tree->root.link };
     while (!IS_NIL(curr)) {
         res.pack.parent = curr;
-        if (tree->comp(curr->value, key) >= 0) {  // curr.key >= key
+        if (tree->comp(NODE(curr)->value, key) >= 0) {  // curr.key >= key
             res.pack.pos = Left;
             res.curr     = curr;
             curr         = curr->left;
@@ -328,11 +591,13 @@ static find_result_t lower_bound(rbt_tree* tree, void* key) {
     return res;
 }
 static find_result_t upper_bound(rbt_tree* tree, void* key) {
-    node_t*       curr = tree->root.parent;
-    find_result_t res  = { .pack = { .parent = tree->root.parent }, .curr = &tree->root };
+    if (tree->keytype != Comparator)
+        return upper_bound_key(tree, extract_key(tree, key));
+    rbt_link*     curr = tree->root.link.parent;
+    find_result_t res  = { .pack = { .parent = tree->root.link.parent }, .curr = &tree->root.link };
     while (!IS_NIL(curr)) {
         res.pack.parent = curr;
-        if (tree->comp(curr->value, key) > 0) {  // curr.key > key
+        if (tree->comp(NODE(curr)->value, key) > 0) {  // curr.key > key
             res.pack.pos = Left;
             res.curr     = curr;
             curr         = curr->left;
@@ -346,21 +611,25 @@ static find_result_t upper_bound(rbt_tree* tree, void* key) {
 }
 
 nodeptr_pair_t equal_range(rbt_tree* tree, void* key) {
-    node_t* root  = &tree->root;
-    node_t *first = root, *second = root;
-    node_t* curr = root->parent;
+    if (tree->keytype != Comparator) {
+        uint64_t k = extract_key(tree, key);
+        return (nodeptr_pair_t){ lower_bound_key(tree, k).curr, upper_bound_key(tree, k).curr };
+    }
+    rbt_link* root  = &tree->root.link;
+    rbt_link *first = root, *second = root;
+    rbt_link* curr  = root->parent;
     while (!IS_NIL(curr))
-        if (tree->comp(curr->value, key) < 0)
+        if (tree->comp(NODE(curr)->value, key) < 0)
             curr = curr->right;
         else {
-            if (IS_NIL(second) && tree->comp(key, curr->value) < 0)
+            if (IS_NIL(second) && tree->comp(key, NODE(curr)->value) < 0)
                 second = curr;
             first = curr;
             curr  = curr->left;
         }
     curr = IS_NIL(second) ? root->parent : second->left;
     while (!IS_NIL(curr))
-        if (tree->comp(key, curr->value) < 0) {
+        if (tree->comp(key, NODE(curr)->value) < 0) {
             second = curr;
             curr   = curr->left;
         }
@@ -369,88 +638,153 @@ nodeptr_pair_t equal_range(rbt_tree* tree, void* key) {
     return (nodeptr_pair_t){ first, second };
 }
 
-static node_t* insert_at(rbt_tree* tree, ins_pack_t pack, node_t* new_node) {
-    node_t* root     = &tree->root;
-    new_node->parent = pack.parent;
-    if (pack.parent == root)
-        root->parent = root->left = root->right = new_node;
-    else {
-        if (pack.pos == Left) {
-            pack.parent->left = new_node;
-            if (pack.parent == root->left)
-                root->left = new_node;
-        }
-        else {
-            pack.parent->right = new_node;
-            if (pack.parent == root->right)
-                root->right = new_node;
-        }
+static uint64_t extract_key(rbt_tree* tree, void* value) {
+    uint64_t key;
+    memcpy(&key, (char*)value + tree->key_offset, sizeof(key));
+    return tree->keytype == Signed64 ? key ^ SIGN_BIT : key;
+}
+
+static int compare(rbt_tree* tree, rbt_link* node, void* key) {
+    if (tree->keytype == Comparator)
+        return tree->comp(NODE(node)->value, key);
+    uint64_t k = extract_key(tree, key);
+    return (KEY_OF(node) > k) - (KEY_OF(node) < k);
+}
+
+// the branches below only select values, so they compile to conditional moves
+static find_result_t lower_bound_key(rbt_tree* tree, uint64_t key) {
+    rbt_link*     curr = tree->root.link.parent;
+    find_result_t res  = { .pack = { .parent = tree->root.link.parent }, .curr = &tree->root.link };
+    while (!IS_NIL(curr)) {
+        bool left       = KEY_OF(curr) >= key;
+        res.pack.parent = curr;
+        res.pack.pos    = left ? Left : Right;
+        res.curr        = left ? curr : res.curr;
+        curr            = left ? curr->left : curr->right;
+    }
+    return res;
+}
+
+static find_result_t upper_bound_key(rbt_tree* tree, uint64_t key) {
+    rbt_link*     curr = tree->root.link.parent;
+    find_result_t res  = { .pack = { .parent = tree->root.link.parent }, .curr = &tree->root.link };
+    while (!IS_NIL(curr)) {
+        bool left       = KEY_OF(curr) > key;
+        res.pack.parent = curr;
+        res.pack.pos    = left ? Left : Right;
+        res.curr        = left ? curr : res.curr;
+        curr            = left ? curr->left : curr->right;
     }
-    insert_fixup(tree, new_node);
+    return res;
+}
+
+static rbt_link* insert_at(rbt_tree* tree, ins_pack_t pack, rbt_link* new_node) {
+    rbt_link_insert(&tree->root.link, pack.parent, pack.pos == Left, new_node);
+    new_node->color |= tree->layout;  // rbt_link_insert only sets the color and nil bits
     ++tree->size;
     return new_node;
 }
 
-static node_t* create_node(rbt_tree* tree, void* value) {
-    node_t* new_node = (node_t*)malloc(sizeof(node_t));
+static void erase_node(rbt_tree* tree, rbt_link* node, rbt_val_dtor dtor) {
+    tree->size -= value_count(node);
+    destroy_values(node, dtor);
+    extract_node(&tree->root.link, node);
+    free(node);
+}
+
+static rbt_insert_result_t insert_multi(rbt_tree* tree, void* value) {
+    find_result_t res = lower_bound(tree, value);
+    int           ret = ENOMEM;
+    if (IS_NIL(res.curr) || compare(tree, res.curr, value) != 0) {
+        rbt_link* new_node = create_node(tree, value);
+        if (new_node) {
+            res.curr = insert_at(tree, res.pack, new_node);
+            ret      = 0;
+        }
+        return (rbt_insert_result_t){ .pos = make_iter(res.curr), .err = ret };
+    }
+    ret = bucket_push(res.curr, value);  // no new node, so no rebalancing
+    if (ret == 0)
+        ++tree->size;
+    return (rbt_insert_result_t){ .pos = { .node = NODE(res.curr), .index = value_count(res.curr) - 1 }, .err = ret };
+}
+
+static rbt_link* create_node(rbt_tree* tree, void* value) {
+    size_t    size     = tree->multi                  ? sizeof(multi_node_t)
+                         : tree->keytype != Comparator ? sizeof(keyed_node_t)
+                                                       : sizeof(node_t);
+    rbt_link* new_node = (rbt_link*)malloc(size);
     if (new_node) {
         assert(value);
-        new_node->value = value;
-        new_node->color = 0;
-        new_node->left = new_node->parent = new_node->right = &tree->root;
+        new_node->color    = tree->layout;  // for VALUE_OF until rbt_link_insert sets the color
+        VALUE_OF(new_node) = value;
+        if (tree->keytype != Comparator)
+            KEY_OF(new_node) = extract_key(tree, value);
+        if (tree->multi)
+            BUCKET_OF(new_node) = NULL;
+        new_node->left = new_node->parent = new_node->right = &tree->root.link;
     }
     return new_node;
 }
 
-static void take_node(node_t* node, node_t* suc) {
-    if (IS_LEFT(node))
-        node->parent->left = suc;
-    else if (IS_RIGHT(node))
-        node->parent->right = suc;
-    if (!IS_NIL(suc))
-        suc->parent = node->parent;
-}
-
-static node_t* extract_node(rbt_tree* tree, node_t* node) {
-    node_t* root = &tree->root;
-    node_t* suc  = NULL;
-    if (root->left == node)
-        suc = root->left = IS_NIL(node->right) ? node->parent : leftmost(node->right);
-    if (root->right == node)
-        suc = root->right = IS_NIL(node->left) ? node->parent : rightmost(node->left);
-    if (root->parent == node)
-        root->parent = suc ? suc : (IS_NIL(node->right) ? root : leftmost(node->right));
-
-    node_t* fixnode;
-    int     color = COLOR_OF(node);
-    if (IS_NIL(node->left)) {
+static void extract_node(rbt_link* root, rbt_link* node) {
+    rbt_link* suc  = node;  // the node which actually leaves its position
+    rbt_link* fixnode;
+    rbt_link* fixparent;
+    if (IS_NIL(node->left))
         fixnode = node->right;
-        take_node(node, node->right);
-    }
-    else if (IS_NIL(node->right)) {
+    else if (IS_NIL(node->right))
         fixnode = node->left;
-        take_node(node, node->left);
-    }
     else {
         suc     = leftmost(node->right);
-        color   = COLOR_OF(suc);
         fixnode = suc->right;
-        if (suc->parent == node)
-            fixnode->parent = suc;
-        else {
-            take_node(suc, suc->right);
-            suc->right         = node->right;
-            suc->right->parent = suc;
+    }
+
+    if (suc != node) {  // relink suc in place of node
+        node->left->parent = suc;
+        suc->left          = node->left;
+        if (suc != node->right) {
+            fixparent = suc->parent;
+            if (!IS_NIL(fixnode))
+                fixnode->parent = fixparent;
+            fixparent->left     = fixnode;
+            suc->right          = node->right;
+            node->right->parent = suc;
         }
-        take_node(node, suc);
-        suc->left         = node->left;
-        suc->left->parent = suc;
+        else
+            fixparent = suc;
+        if (IS_ACTUAL_ROOT(node))
+            root->parent = suc;
+        else if (IS_LEFT(node))
+            node->parent->left = suc;
+        else
+            node->parent->right = suc;
+        suc->parent = node->parent;
+
+        int color = COLOR_OF(suc);
         set_color(suc, COLOR_OF(node));
+        set_color(node, color);
+    }
+    else {
+        fixparent = node->parent;
+        if (!IS_NIL(fixnode))
+            fixnode->parent = fixparent;
+        if (IS_ACTUAL_ROOT(node))
+            root->parent = IS_NIL(fixnode) ? root : fixnode;
+        else if (IS_LEFT(node))
+            node->parent->left = fixnode;
+        else
+            node->parent->right = fixnode;
+        if (root->left == node)
+            root->left = IS_NIL(fixnode) ? fixparent : leftmost(fixnode);
+        if (root->right == node)
+            root->right = IS_NIL(fixnode) ? fixparent : rightmost(fixnode);
     }
-    return color == BLACK ? fixnode : tree->root.parent;
+    if (IS_BLACK(node))
+        erase_fixup(root, fixnode, fixparent);
 }
 
-static void display(rbt_tree* tree, bool* visited, node_t* node, size_t size, bool position, rbt_tree_print tprint,
+static void display(rbt_tree* tree, bool* visited, rbt_link* node, size_t size, bool position, rbt_tree_print tprint,
                     rbt_val_print vprint) {
     if (size > MAX_DEPTH)
         return;
@@ -459,13 +793,17 @@ static void display(rbt_tree* tree, bool* visited, node_t* node, size_t size, bo
     if (IS_NIL(node))
         tprint(position ? "  ├─ \n" : "  └─ \n");
     else {
-        if (node->parent == &tree->root)
+        if (node->parent == &tree->root.link)
             tprint("└─ ");
         else if (IS_LEFT(node))
             tprint("  └─ ");
         else
             tprint("  ├─ ");
-        vprint(node->value);
+        vprint(VALUE_OF(node));
+        for (size_t i = 1; i < value_count(node); ++i) {
+            tprint(" ");
+            vprint(value_at(node, i));
+        }
         tprint("\n");
         if (!IS_NIL(node->left) || !IS_NIL(node->right)) {
             visited[size + 1] = true;
@@ -476,9 +814,119 @@ static void display(rbt_tree* tree, bool* visited, node_t* node, size_t size, bo
     }
 }
 
+// parallel traversal
+static int parallel(job_t* job, void* acc, rbt_acc_combine combine, size_t nthreads) {
+    if (nthreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads  = cpus > 0 ? (size_t)cpus : 1;
+    }
+    size_t     depth = split_depth(nthreads);
+    int        ret   = ENOMEM;
+    pthread_t* tids  = (pthread_t*)malloc(sizeof(pthread_t) * nthreads);
+    bool*      async = (bool*)calloc(nthreads, sizeof(bool));
+    job->spans       = (span_t*)malloc(sizeof(span_t) << (depth + 1));
+    job->nspans      = 0;
+    job->accs        = NULL;
+    atomic_init(&job->next, 0);
+    if (tids && async && job->spans) {
+        split(job->tree, job->lo, job->hi, job->tree->root.link.parent, depth, job->spans, &job->nspans);
+        if (combine)
+            job->accs = (char*)malloc(job->acc_size * job->nspans + 1);
+        if (job->accs || !combine) {
+            for (size_t i = 0; combine && i < job->nspans; ++i)
+                memcpy(job->accs + i * job->acc_size, acc, job->acc_size);
+            if (nthreads > job->nspans)
+                nthreads = job->nspans;
+            for (size_t i = 1; i < nthreads; ++i)
+                async[i] = pthread_create(tids + i, NULL, work, job) == 0;
+            work(job);  // the calling thread claims spans as well, so a thread that failed to start costs only time
+            for (size_t i = 1; i < nthreads; ++i)
+                if (async[i])
+                    pthread_join(tids[i], NULL);
+            for (size_t i = 0; combine && i < job->nspans; ++i)  // in span order, whoever folded each of them
+                combine(acc, job->accs + i * job->acc_size, job->ctx);
+            ret = 0;
+        }
+    }
+
+    free(job->spans);
+    free(job->accs);
+    free(tids);
+    free(async);
+    return ret;
+}
+
+// subtrees at a fixed depth differ a lot in size, so cut many more of them than there are threads
+static size_t split_depth(size_t nthreads) {
+    size_t depth = 0;
+    while (depth < MAX_SPLIT_DEPTH && ((size_t)1 << depth) < nthreads * SPANS_PER_THREAD)
+        ++depth;
+    return depth;
+}
+
+// cuts the part of the subtree within [lo, hi) into in-order spans, expanding nodes down to depth
+static void split(rbt_tree* tree, void* lo, void* hi, rbt_link* node, size_t depth, span_t* spans, size_t* n) {
+    if (IS_NIL(node))
+        return;
+    if (depth == 0) {
+        spans[(*n)++] = (span_t){ .node = node, .whole = true };
+        return;
+    }
+    bool below = lo && compare(tree, node, lo) < 0;   // the node and its left subtree precede lo
+    bool above = hi && compare(tree, node, hi) >= 0;  // the node and its right subtree follow hi
+    if (!below)
+        split(tree, lo, hi, node->left, depth - 1, spans, n);
+    if (!below && !above)
+        spans[(*n)++] = (span_t){ .node = node, .whole = false };
+    if (!above)
+        split(tree, lo, hi, node->right, depth - 1, spans, n);
+}
+
+static void* work(void* arg) {
+    job_t* job = (job_t*)arg;
+    for (size_t i; (i = atomic_fetch_add_explicit(&job->next, 1, memory_order_relaxed)) < job->nspans;) {
+        void* acc = job->accs ? job->accs + i * job->acc_size : NULL;
+        if (job->spans[i].whole)
+            walk(job, job->spans[i].node, acc);
+        else
+            visit_values(job, job->spans[i].node, acc);
+    }
+    return NULL;
+}
+
+static void walk(job_t* job, rbt_link* node, void* acc) {
+    rbt_link* stack[MAX_HEIGHT];
+    size_t    top = 0;
+    while (top > 0 || !IS_NIL(node)) {
+        if (!IS_NIL(node)) {
+            if (job->lo && compare(job->tree, node, job->lo) < 0)
+                node = node->right;  // skip the node and its left subtree
+            else {
+                stack[top++] = node;
+                node         = node->left;
+            }
+        }
+        else {
+            node = stack[--top];
+            if (job->hi && compare(job->tree, node, job->hi) >= 0)
+                return;  // everything left in this subtree follows too
+            visit_values(job, node, acc);
+            node = node->right;
+        }
+    }
+}
+
+static void visit_values(job_t* job, rbt_link* node, void* acc) {
+    for (size_t i = 0; i < value_count(node); ++i)
+        if (job->fold)
+            job->fold(acc, value_at(node, i), job->ctx);
+        else
+            job->visit(value_at(node, i), job->ctx);
+}
+
 // rb tree implementation
-static void insert_fixup(rbt_tree* tree, node_t* node) {
-    node_t* uncle;
+static void insert_fixup(rbt_link* root, rbt_link* node) {
+    rbt_link* uncle;
     while (!IS_ACTUAL_ROOT(node) && IS_RED(node->parent)) {
         if (node->parent == node->parent->parent->left) {
             uncle = node->parent->parent->right;
@@ -492,11 +940,11 @@ static void insert_fixup(rbt_tree* tree, node_t* node) {
             else {
                 if (IS_RIGHT(node)) {
                     node = node->parent;
-                    rotate_left(tree, node);
+                    rotate_left(root, node);
                 }
                 set_color(node->parent, BLACK);
                 set_color(node->parent->parent, RED);
-                rotate_right(tree, node->parent->parent);
+                rotate_right(root, node->parent->parent);
             }
         }
         else {
@@ -511,85 +959,86 @@ static void insert_fixup(rbt_tree* tree, node_t* node) {
             else {
                 if (IS_LEFT(node)) {
                     node = node->parent;
-                    rotate_right(tree, node);
+                    rotate_right(root, node);
                 }
                 set_color(node->parent, BLACK);
                 set_color(node->parent->parent, RED);
-                rotate_left(tree, node->parent->parent);
+                rotate_left(root, node->parent->parent);
             }
         }
     }
-    set_color(tree->root.parent, BLACK);
+    set_color(root->parent, BLACK);
 }
 
-static void erase_fixup(rbt_tree* tree, node_t* node) {
-    node_t* bro;
-    while (!IS_ACTUAL_ROOT(node) && IS_BLACK(node)) {
-        if (IS_LEFT(node)) {
-            bro = node->parent->right;
+static void erase_fixup(rbt_link* root, rbt_link* node, rbt_link* parent) {
+    rbt_link* bro;
+    while (node != root->parent && IS_BLACK(node)) {
+        if (node == parent->left) {
+            bro = parent->right;
             if (IS_RED(bro)) {
                 set_color(bro, BLACK);
-                set_color(node->parent, RED);
-                rotate_left(tree, node->parent);
-                bro = node->parent->right;
+                set_color(parent, RED);
+                rotate_left(root, parent);
+                bro = parent->right;
             }
             if (IS_BLACK(bro->left) && IS_BLACK(bro->right)) {
                 set_color(bro, RED);
-                node         = node->parent;
-                node->parent = node->parent->parent;
+                node   = parent;
+                parent = parent->parent;
             }
             else {
                 if (IS_BLACK(bro->right)) {
                     set_color(bro->left, BLACK);
                     set_color(bro, RED);
-                    rotate_right(tree, bro);
-                    bro = node->parent->right;
+                    rotate_right(root, bro);
+                    bro = parent->right;
                 }
-                set_color(bro, COLOR_OF(node->parent));
-                set_color(node->parent, BLACK);
+                set_color(bro, COLOR_OF(parent));
+                set_color(parent, BLACK);
                 set_color(bro->right, BLACK);
-                rotate_left(tree, node->parent);
+                rotate_left(root, parent);
                 break;
             }
         }
         else {
-            bro = node->parent->left;
+            bro = parent->left;
             if (IS_RED(bro)) {
                 set_color(bro, BLACK);
-                set_color(node->parent, RED);
-                rotate_right(tree, node->parent);
-                bro = node->parent->left;
+                set_color(parent, RED);
+                rotate_right(root, parent);
+                bro = parent->left;
             }
             if (IS_BLACK(bro->right) && IS_BLACK(bro->left)) {
                 set_color(bro, RED);
-                node         = node->parent;
-                node->parent = node->parent->parent;
+                node   = parent;
+                parent = parent->parent;
             }
             else {
                 if (IS_BLACK(bro->left)) {
                     set_color(bro->right, BLACK);
                     set_color(bro, RED);
-                    rotate_left(tree, bro);
-                    bro = node->parent->left;
+                    rotate_left(root, bro);
+                    bro = parent->left;
                 }
-                set_color(bro, COLOR_OF(node->parent));
-                set_color(node->parent, BLACK);
+                set_color(bro, COLOR_OF(parent));
+                set_color(parent, BLACK);
                 set_color(bro->left, BLACK);
-                rotate_right(tree, node->parent);
+                rotate_right(root, parent);
                 break;
             }
         }
     }
-    set_color(tree->root.parent, BLACK);
+    set_color(node, BLACK);
 }
-static node_t* rotate_left(rbt_tree* tree, node_t* node) {
-    node_t* pivot = node->right;
+
+static rbt_link* rotate_left(rbt_link* root, rbt_link* node) {
+    rbt_link* pivot = node->right;
     node->right   = pivot->left;
     if (!IS_NIL(pivot->left))
         pivot->left->parent = node;
     pivot->parent = node->parent;
     if (IS_ACTUAL_ROOT(node))
-        tree->root.parent = pivot;
+        root->parent = pivot;
     else {
         if (IS_LEFT(node))
             node->parent->left = pivot;
@@ -602,14 +1051,14 @@ static node_t* rotate_left(rbt_tree* tree, node_t* node) {
     return pivot;
 }
 
-static node_t* rotate_right(rbt_tree* tree, node_t* node) {
-    node_t* pivot = node->left;
+static rbt_link* rotate_right(rbt_link* root, rbt_link* node) {
+    rbt_link* pivot = node->left;
     node->left    = pivot->right;
     if (!IS_NIL(pivot->right))
         pivot->right->parent = node;
     pivot->parent = node->parent;
     if (IS_ACTUAL_ROOT(node))
-        tree->root.parent = pivot;
+        root->parent = pivot;
     else {
         if (IS_RIGHT(node))
             node->parent->right = pivot;
@@ -0,0 +1,507 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../include/rb_tree.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RED 0
+#define BLACK 1
+
+#define MAGIC "RBTMAP2"
+#define INITIAL_CAPACITY 4096
+#define MAX_HEIGHT 128 // for traversal stacks, a red-black tree is never higher than 2 * log2(size + 1)
+
+#define HEADER(tree) ((header_t*)(tree)->base)
+#define AT(tree, off) ((mnode_t*)((tree)->base + (off)))
+#define VALUE(tree, off) ((void*)((char*)AT(tree, off) + ROUND_UP(sizeof(mnode_t))))
+#define NIL ((offset_t)offsetof(header_t, nil))
+#define ALIGN _Alignof(max_align_t)  // of every node and so of every value, the mapping starts on a page
+#define ROUND_UP(n) (((n) + ALIGN - 1) / ALIGN * ALIGN)
+#define FIRST_NODE ((offset_t)ROUND_UP(sizeof(header_t)))
+
+typedef uint64_t offset_t;  // from the start of the mapping, so the file can be mapped anywhere
+
+typedef struct {  // followed by value_size bytes of inline value
+    offset_t left;
+    offset_t right;
+    offset_t parent;  // next free node while on the free list
+    uint64_t color;
+} mnode_t;
+
+typedef struct {
+    char     magic[8];
+    uint64_t value_size;
+    uint64_t capacity;   // bytes of the file
+    uint64_t used;       // bytes handed out to nodes so far
+    uint64_t size;       // values in the tree
+    offset_t root;
+    offset_t free_list;  // 0 when empty
+    mnode_t  nil;        // shared by every leaf, always black
+} header_t;
+
+typedef struct rbt_mapped_tree {
+    int          fd;
+    char*        base;
+    size_t       length;
+    size_t       stride;  // node plus value, rounded to ALIGN
+    rbt_val_comp comp;
+} rbt_mapped_tree;
+
+// region management
+static int      lock(int fd);
+static int      create(const char* path, size_t value_size);
+static int      remap(rbt_mapped_tree* tree, size_t capacity);
+static int      alloc_node(rbt_mapped_tree* tree, offset_t* off);
+static void     free_node(rbt_mapped_tree* tree, offset_t off);
+static offset_t lower_bound(rbt_mapped_tree* tree, void* key);
+static offset_t minimum(rbt_mapped_tree* tree, offset_t off);
+
+// rb tree implementation
+static void insert_node(rbt_mapped_tree* tree, offset_t node);
+static void erase_node(rbt_mapped_tree* tree, offset_t node);
+static void transplant(rbt_mapped_tree* tree, offset_t node, offset_t suc);
+static void insert_fixup(rbt_mapped_tree* tree, offset_t node);
+static void erase_fixup(rbt_mapped_tree* tree, offset_t node);
+static void rotate_left(rbt_mapped_tree* tree, offset_t node);
+static void rotate_right(rbt_mapped_tree* tree, offset_t node);
+
+rbt_mapped_tree* rbt_open_mapped(const char* path, rbt_val_comp comp, size_t value_size) {
+    if (value_size == 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    rbt_mapped_tree* tree = (rbt_mapped_tree*)malloc(sizeof(rbt_mapped_tree));
+    if (tree == NULL)
+        return NULL;
+    tree->comp   = comp;
+    tree->stride = ROUND_UP(sizeof(mnode_t)) + ROUND_UP(value_size);
+    tree->base   = NULL;
+    tree->length = 0;
+    tree->fd     = open(path, O_RDWR);
+
+    struct stat st;
+    int         err = 0;
+    if (tree->fd < 0 && errno == ENOENT && (err = create(path, value_size)) == 0)
+        tree->fd = open(path, O_RDWR);
+    if (err != 0 || tree->fd < 0 || (err = lock(tree->fd)) != 0 || fstat(tree->fd, &st) != 0)
+        err = err ? err : errno;
+    else if ((size_t)st.st_size < sizeof(header_t))  // files without a whole header are never trees
+        err = EINVAL;
+    else if ((err = remap(tree, (size_t)st.st_size)) == 0) {
+        header_t* header = HEADER(tree);
+        if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0 || header->value_size != value_size
+            || header->used < FIRST_NODE || header->used > (uint64_t)st.st_size
+            || (header->used - FIRST_NODE) % tree->stride != 0)
+            err = EINVAL;
+        else  // only the header is read, whatever the tree size
+            header->capacity = (uint64_t)st.st_size;
+    }
+
+    if (err != 0) {
+        rbt_close_mapped(tree);
+        errno = err;
+        return NULL;
+    }
+    return tree;
+}
+
+int rbt_close_mapped(rbt_mapped_tree* tree) {
+    int ret = 0;
+    if (tree->base && munmap(tree->base, tree->length) != 0)
+        ret = errno;
+    if (tree->fd >= 0 && close(tree->fd) != 0 && ret == 0)
+        ret = errno;
+    free(tree);
+    return ret;
+}
+
+int rbt_sync(rbt_mapped_tree* tree) {
+    if (msync(tree->base, tree->length, MS_SYNC) != 0 || fsync(tree->fd) != 0)
+        return errno;
+    return 0;
+}
+
+int rbt_mapped_insert(rbt_mapped_tree* tree, const void* value) {
+    offset_t node = 0;
+    int      ret  = alloc_node(tree, &node);
+    if (ret == 0) {
+        memcpy(VALUE(tree, node), value, HEADER(tree)->value_size);
+        insert_node(tree, node);
+    }
+    return ret;
+}
+
+int rbt_mapped_insert_unique(rbt_mapped_tree* tree, const void* value) {
+    offset_t pos = lower_bound(tree, (void*)value);
+    if (pos != NIL && tree->comp(VALUE(tree, pos), (void*)value) == 0)
+        return -1;
+    return rbt_mapped_insert(tree, value);
+}
+
+void* rbt_mapped_find(rbt_mapped_tree* tree, void* key) {
+    offset_t pos = lower_bound(tree, key);
+    return (pos == NIL || tree->comp(VALUE(tree, pos), key) != 0) ? NULL : VALUE(tree, pos);
+}
+
+size_t rbt_mapped_erase(rbt_mapped_tree* tree, void* key) {
+    size_t n = 0;
+    for (offset_t pos = lower_bound(tree, key); pos != NIL && tree->comp(VALUE(tree, pos), key) == 0;
+         pos          = lower_bound(tree, key), ++n)
+        erase_node(tree, pos);
+    return n;
+}
+
+size_t rbt_mapped_size(rbt_mapped_tree* tree) { return HEADER(tree)->size; }
+
+void rbt_mapped_clear(rbt_mapped_tree* tree) {
+    header_t* header  = HEADER(tree);
+    header->root      = NIL;
+    header->used      = FIRST_NODE;
+    header->size      = 0;
+    header->free_list = 0;
+}
+
+void rbt_mapped_for_each(rbt_mapped_tree* tree, rbt_val_visit fn, void* ctx) {
+    offset_t stack[MAX_HEIGHT];
+    size_t   top  = 0;
+    offset_t curr = HEADER(tree)->root;
+    while (top > 0 || curr != NIL) {
+        if (curr != NIL) {
+            stack[top++] = curr;
+            curr         = AT(tree, curr)->left;
+        }
+        else {
+            curr = stack[--top];
+            fn(VALUE(tree, curr), ctx);
+            curr = AT(tree, curr)->right;
+        }
+    }
+}
+
+// a write lock on the whole file, held until the descriptor is closed
+static int lock(int fd) {
+    struct flock lk = { .l_type = F_WRLCK, .l_whence = SEEK_SET, .l_start = 0, .l_len = 0 };
+    if (fcntl(fd, F_SETLK, &lk) == 0)
+        return 0;
+    return errno == EACCES || errno == EAGAIN ? EBUSY : errno;
+}
+
+// builds an empty tree in a temporary file next to path and links it to path only once it is complete, so
+// path is either missing or a whole tree, whenever the process dies
+static int create(const char* path, size_t value_size) {
+    size_t length = strlen(path) + 32;
+    char*  tmp    = (char*)malloc(length);
+    if (tmp == NULL)
+        return ENOMEM;
+    snprintf(tmp, length, "%s.%ld.tmp", path, (long)getpid());
+
+    header_t header = {
+        .magic      = MAGIC,
+        .value_size = value_size,
+        .capacity   = INITIAL_CAPACITY,
+        .used       = FIRST_NODE,
+        .size       = 0,
+        .root       = NIL,
+        .free_list  = 0,
+        .nil        = { .left = NIL, .right = NIL, .parent = NIL, .color = BLACK },
+    };
+    int err = 0;
+    int fd  = open(tmp, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+        err = errno;
+    else {
+        ssize_t written = 0;
+        if (ftruncate(fd, INITIAL_CAPACITY) != 0 || (written = pwrite(fd, &header, sizeof(header), 0)) < 0)
+            err = errno;
+        else if ((size_t)written != sizeof(header))
+            err = EIO;
+        else if (fsync(fd) != 0)
+            err = errno;
+        if (close(fd) != 0 && err == 0)
+            err = errno;
+        if (err == 0 && link(tmp, path) != 0 && errno != EEXIST)  // another process may have created it first
+            err = errno;
+        unlink(tmp);
+    }
+    free(tmp);
+    return err;
+}
+
+static int remap(rbt_mapped_tree* tree, size_t capacity) {
+    // map the new size before dropping the old mapping, so a failure leaves the tree usable
+    char* base = (char*)mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, tree->fd, 0);
+    if (base == MAP_FAILED)
+        return errno;
+    if (tree->base)
+        munmap(tree->base, tree->length);
+    tree->base   = base;
+    tree->length = capacity;
+    return 0;
+}
+
+static int alloc_node(rbt_mapped_tree* tree, offset_t* off) {
+    header_t* header = HEADER(tree);
+    if (header->free_list != 0) {
+        *off              = header->free_list;
+        header->free_list = AT(tree, *off)->parent;
+        return 0;
+    }
+    if (header->used + tree->stride > header->capacity) {  // grow the file geometrically
+        size_t capacity = header->capacity * 2;
+        if (capacity < header->used + tree->stride)
+            capacity = header->used + tree->stride;
+        if (ftruncate(tree->fd, (off_t)capacity) != 0)
+            return errno;
+        int ret = remap(tree, capacity);
+        if (ret != 0)
+            return ret;
+        header           = HEADER(tree);
+        header->capacity = capacity;
+    }
+    *off = header->used;
+    header->used += tree->stride;
+    return 0;
+}
+
+static void free_node(rbt_mapped_tree* tree, offset_t off) {
+    AT(tree, off)->parent   = HEADER(tree)->free_list;
+    HEADER(tree)->free_list = off;
+}
+
+static offset_t lower_bound(rbt_mapped_tree* tree, void* key) {
+    offset_t res  = NIL;
+    offset_t curr = HEADER(tree)->root;
+    while (curr != NIL)
+        if (tree->comp(VALUE(tree, curr), key) >= 0) {  // curr.key >= key
+            res  = curr;
+            curr = AT(tree, curr)->left;
+        }
+        else
+            curr = AT(tree, curr)->right;
+    return res;
+}
+
+static offset_t minimum(rbt_mapped_tree* tree, offset_t off) {
+    while (AT(tree, off)->left != NIL)
+        off = AT(tree, off)->left;
+    return off;
+}
+
+// rb tree implementation
+static void insert_node(rbt_mapped_tree* tree, offset_t node) {
+    header_t* header = HEADER(tree);
+    offset_t  parent = NIL;
+    bool      left   = true;
+    void*     value  = VALUE(tree, node);
+    for (offset_t curr = header->root; curr != NIL; curr = left ? AT(tree, curr)->left : AT(tree, curr)->right) {
+        parent = curr;
+        left   = tree->comp(VALUE(tree, curr), value) > 0;  // equal values go after the existing ones
+    }
+
+    mnode_t* n = AT(tree, node);
+    n->left = n->right = NIL;
+    n->parent          = parent;
+    n->color           = RED;
+    if (parent == NIL)
+        header->root = node;
+    else if (left)
+        AT(tree, parent)->left = node;
+    else
+        AT(tree, parent)->right = node;
+    insert_fixup(tree, node);
+    ++header->size;
+}
+
+static void erase_node(rbt_mapped_tree* tree, offset_t node) {
+    mnode_t* n     = AT(tree, node);
+    offset_t fix   = NIL;
+    uint64_t color = n->color;
+    if (n->left == NIL) {
+        fix = n->right;
+        transplant(tree, node, n->right);
+    }
+    else if (n->right == NIL) {
+        fix = n->left;
+        transplant(tree, node, n->left);
+    }
+    else {
+        offset_t suc = minimum(tree, n->right);
+        mnode_t* s   = AT(tree, suc);
+        color        = s->color;
+        fix          = s->right;
+        if (s->parent == node)
+            AT(tree, fix)->parent = suc;  // fix may be nil, whose parent the fixup relies on
+        else {
+            transplant(tree, suc, s->right);
+            s->right                   = n->right;
+            AT(tree, s->right)->parent = suc;
+        }
+        transplant(tree, node, suc);
+        s->left                   = n->left;
+        AT(tree, s->left)->parent = suc;
+        s->color                  = n->color;
+    }
+    if (color == BLACK)
+        erase_fixup(tree, fix);
+    free_node(tree, node);
+    --HEADER(tree)->size;
+}
+
+static void transplant(rbt_mapped_tree* tree, offset_t node, offset_t suc) {
+    offset_t parent = AT(tree, node)->parent;
+    if (parent == NIL)
+        HEADER(tree)->root = suc;
+    else if (node == AT(tree, parent)->left)
+        AT(tree, parent)->left = suc;
+    else
+        AT(tree, parent)->right = suc;
+    AT(tree, suc)->parent = parent;
+}
+
+static void insert_fixup(rbt_mapped_tree* tree, offset_t node) {
+    while (AT(tree, AT(tree, node)->parent)->color == RED) {
+        offset_t parent = AT(tree, node)->parent;
+        offset_t grand  = AT(tree, parent)->parent;
+        if (parent == AT(tree, grand)->left) {
+            offset_t uncle = AT(tree, grand)->right;
+            if (AT(tree, uncle)->color == RED) {
+                AT(tree, parent)->color = BLACK;
+                AT(tree, uncle)->color  = BLACK;
+                AT(tree, grand)->color  = RED;
+                node                    = grand;
+            }
+            else {
+                if (node == AT(tree, parent)->right) {
+                    node = parent;
+                    rotate_left(tree, node);
+                    parent = AT(tree, node)->parent;
+                }
+                AT(tree, parent)->color = BLACK;
+                AT(tree, grand)->color  = RED;
+                rotate_right(tree, grand);
+            }
+        }
+        else {
+            offset_t uncle = AT(tree, grand)->left;
+            if (AT(tree, uncle)->color == RED) {
+                AT(tree, parent)->color = BLACK;
+                AT(tree, uncle)->color  = BLACK;
+                AT(tree, grand)->color  = RED;
+                node                    = grand;
+            }
+            else {
+                if (node == AT(tree, parent)->left) {
+                    node = parent;
+                    rotate_right(tree, node);
+                    parent = AT(tree, node)->parent;
+                }
+                AT(tree, parent)->color = BLACK;
+                AT(tree, grand)->color  = RED;
+                rotate_left(tree, grand);
+            }
+        }
+    }
+    AT(tree, HEADER(tree)->root)->color = BLACK;
+}
+
+static void erase_fixup(rbt_mapped_tree* tree, offset_t node) {
+    while (node != HEADER(tree)->root && AT(tree, node)->color == BLACK) {
+        offset_t parent = AT(tree, node)->parent;
+        if (node == AT(tree, parent)->left) {
+            offset_t bro = AT(tree, parent)->right;
+            if (AT(tree, bro)->color == RED) {
+                AT(tree, bro)->color    = BLACK;
+                AT(tree, parent)->color = RED;
+                rotate_left(tree, parent);
+                bro = AT(tree, parent)->right;
+            }
+            if (AT(tree, AT(tree, bro)->left)->color == BLACK && AT(tree, AT(tree, bro)->right)->color == BLACK) {
+                AT(tree, bro)->color = RED;
+                node                 = parent;
+            }
+            else {
+                if (AT(tree, AT(tree, bro)->right)->color == BLACK) {
+                    AT(tree, AT(tree, bro)->left)->color = BLACK;
+                    AT(tree, bro)->color                 = RED;
+                    rotate_right(tree, bro);
+                    bro = AT(tree, parent)->right;
+                }
+                AT(tree, bro)->color                  = AT(tree, parent)->color;
+                AT(tree, parent)->color               = BLACK;
+                AT(tree, AT(tree, bro)->right)->color = BLACK;
+                rotate_left(tree, parent);
+                node = HEADER(tree)->root;
+            }
+        }
+        else {
+            offset_t bro = AT(tree, parent)->left;
+            if (AT(tree, bro)->color == RED) {
+                AT(tree, bro)->color    = BLACK;
+                AT(tree, parent)->color = RED;
+                rotate_right(tree, parent);
+                bro = AT(tree, parent)->left;
+            }
+            if (AT(tree, AT(tree, bro)->right)->color == BLACK && AT(tree, AT(tree, bro)->left)->color == BLACK) {
+                AT(tree, bro)->color = RED;
+                node                 = parent;
+            }
+            else {
+                if (AT(tree, AT(tree, bro)->left)->color == BLACK) {
+                    AT(tree, AT(tree, bro)->right)->color = BLACK;
+                    AT(tree, bro)->color                  = RED;
+                    rotate_left(tree, bro);
+                    bro = AT(tree, parent)->left;
+                }
+                AT(tree, bro)->color                 = AT(tree, parent)->color;
+                AT(tree, parent)->color              = BLACK;
+                AT(tree, AT(tree, bro)->left)->color = BLACK;
+                rotate_right(tree, parent);
+                node = HEADER(tree)->root;
+            }
+        }
+    }
+    AT(tree, node)->color = BLACK;
+}
+
+static void rotate_left(rbt_mapped_tree* tree, offset_t node) {
+    mnode_t* n     = AT(tree, node);
+    offset_t pivot = n->right;
+    mnode_t* p     = AT(tree, pivot);
+    n->right       = p->left;
+    if (p->left != NIL)
+        AT(tree, p->left)->parent = node;
+    p->parent = n->parent;
+    if (n->parent == NIL)
+        HEADER(tree)->root = pivot;
+    else if (node == AT(tree, n->parent)->left)
+        AT(tree, n->parent)->left = pivot;
+    else
+        AT(tree, n->parent)->right = pivot;
+    p->left   = node;
+    n->parent = pivot;
+}
+
+static void rotate_right(rbt_mapped_tree* tree, offset_t node) {
+    mnode_t* n     = AT(tree, node);
+    offset_t pivot = n->left;
+    mnode_t* p     = AT(tree, pivot);
+    n->left        = p->right;
+    if (p->right != NIL)
+        AT(tree, p->right)->parent = node;
+    p->parent = n->parent;
+    if (n->parent == NIL)
+        HEADER(tree)->root = pivot;
+    else if (node == AT(tree, n->parent)->right)
+        AT(tree, n->parent)->right = pivot;
+    else
+        AT(tree, n->parent)->left = pivot;
+    p->right  = node;
+    n->parent = pivot;
+}
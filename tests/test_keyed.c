@@ -0,0 +1,167 @@
+// rbt_create_i64 / rbt_create_u64 trees against comparator trees holding the same values
+#include "../include/rb_tree.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N 30000
+#define OFFSET 3  // an unaligned key inside a raw buffer
+
+typedef struct {
+    char    tag[5];
+    int64_t key;  // at a nonzero offset
+    int     id;
+} record_t;
+
+typedef struct {
+    unsigned char bytes[16];
+} raw_t;
+
+static record_t records[N];
+static raw_t    raws[N];
+
+static int comp_record(void* a, void* b) {
+    int64_t l = ((record_t*)a)->key, r = ((record_t*)b)->key;
+    return (l > r) - (l < r);
+}
+
+static int64_t raw_key(void* raw) {
+    int64_t key;
+    memcpy(&key, ((raw_t*)raw)->bytes + OFFSET, sizeof(key));
+    return key;
+}
+
+static int comp_raw(void* a, void* b) {
+    int64_t l = raw_key(a), r = raw_key(b);
+    return (l > r) - (l < r);
+}
+
+static int comp_u64(void* a, void* b) {
+    uint64_t l = *(uint64_t*)a, r = *(uint64_t*)b;
+    return (l > r) - (l < r);
+}
+
+static void dtor(void* value) { (void)value; }
+
+static uint64_t next_rand(uint64_t* state) {  // xorshift64
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// small keys of both signs collide often, the rest spread over the whole range including the extremes
+static int64_t random_key(uint64_t* state) {
+    uint64_t r = next_rand(state);
+    switch (r % 8) {
+    case 0:
+        return INT64_MIN + (int64_t)(r >> 60);
+    case 1:
+        return INT64_MAX - (int64_t)(r >> 60);
+    case 2:
+        return (int64_t)(r >> 3) * (r & 4 ? -1 : 1);
+    default:
+        return (int64_t)(r >> 54) - 512;
+    }
+}
+
+// equal values keep their insertion order in both trees, so the iterations must agree value by value
+static void expect_same(rbt_tree* keyed, rbt_tree* ref) {
+    assert(rbt_size(keyed) == rbt_size(ref));
+    rbt_iterator it = rbt_begin(keyed), expected = rbt_begin(ref);
+    for (; rbt_iter_neq(expected, rbt_end(ref)); it = rbt_iter_next(it), expected = rbt_iter_next(expected))
+        assert(rbt_iter_val(it) == rbt_iter_val(expected));
+    assert(rbt_iter_eq(it, rbt_end(keyed)));
+}
+
+static void expect_same_pos(rbt_tree* keyed, rbt_iterator it, rbt_tree* ref, rbt_iterator expected) {
+    if (rbt_iter_eq(expected, rbt_end(ref)))
+        assert(rbt_iter_eq(it, rbt_end(keyed)));
+    else
+        assert(rbt_iter_neq(it, rbt_end(keyed)) && rbt_iter_val(it) == rbt_iter_val(expected));
+}
+
+static void expect_same_lookups(rbt_tree* keyed, rbt_tree* ref, void* key) {
+    expect_same_pos(keyed, rbt_find(keyed, key), ref, rbt_find(ref, key));
+    expect_same_pos(keyed, rbt_lower_bound(keyed, key), ref, rbt_lower_bound(ref, key));
+    expect_same_pos(keyed, rbt_upper_bound(keyed, key), ref, rbt_upper_bound(ref, key));
+
+    rbt_eqrange_result_t range = rbt_eqaul_range(keyed, key), expected = rbt_eqaul_range(ref, key);
+    expect_same_pos(keyed, range.first, ref, expected.first);
+    expect_same_pos(keyed, range.last, ref, expected.last);
+    for (; rbt_iter_neq(expected.first, expected.last);
+         range.first = rbt_iter_next(range.first), expected.first = rbt_iter_next(expected.first))
+        assert(rbt_iter_val(range.first) == rbt_iter_val(expected.first));
+    assert(rbt_iter_eq(range.first, range.last));
+}
+
+// the same operations on a keyed tree and on a comparator tree, values come from `values` with `stride` bytes each
+static void run(rbt_tree* keyed, rbt_tree* ref, char* values, size_t stride) {
+    for (size_t i = 0; i < N; ++i) {
+        void* value = values + i * stride;
+        if (i % 3 == 0) {
+            rbt_insert_result_t res = rbt_insert_unique(keyed, value), expected = rbt_insert_unique(ref, value);
+            assert(res.err == expected.err && rbt_iter_val(res.pos) == rbt_iter_val(expected.pos));
+        }
+        else {
+            rbt_insert(keyed, value);
+            rbt_insert(ref, value);
+        }
+    }
+    expect_same(keyed, ref);
+
+    for (size_t i = 0; i < N; i += 7)
+        expect_same_lookups(keyed, ref, values + i * stride);
+    for (size_t i = 0; i < N; i += 5)
+        assert(rbt_erase(keyed, values + i * stride, dtor) == rbt_erase(ref, values + i * stride, dtor));
+    expect_same(keyed, ref);
+    for (size_t i = 0; i < N; i += 3)
+        expect_same_lookups(keyed, ref, values + i * stride);
+
+    // erasing through an equal range found by key
+    for (size_t i = 1; i < N; i += 11) {
+        rbt_eqrange_result_t range = rbt_eqaul_range(keyed, values + i * stride);
+        rbt_eqrange_result_t expected = rbt_eqaul_range(ref, values + i * stride);
+        rbt_erase_range(keyed, range.first, range.last, dtor);
+        rbt_erase_range(ref, expected.first, expected.last, dtor);
+    }
+    expect_same(keyed, ref);
+}
+
+int main(void) {
+    uint64_t state = 88172645463325252ull;
+
+    for (int i = 0; i < N; ++i) {
+        records[i] = (record_t){ .key = random_key(&state), .id = i };
+        int64_t key = random_key(&state);
+        memset(raws + i, 0xa5, sizeof(raw_t));
+        memcpy(raws[i].bytes + OFFSET, &key, sizeof(key));
+    }
+
+    rbt_tree* keyed = rbt_create_i64(offsetof(record_t, key));
+    rbt_tree* ref   = rbt_create(comp_record);
+    run(keyed, ref, (char*)records, sizeof(record_t));
+    rbt_destroy(keyed, dtor);
+    rbt_destroy(ref, dtor);
+
+    keyed = rbt_create_i64(OFFSET);
+    ref   = rbt_create(comp_raw);
+    run(keyed, ref, (char*)raws, sizeof(raw_t));
+    rbt_destroy(keyed, dtor);
+    rbt_destroy(ref, dtor);
+
+    // values on both sides of 2^63 must keep their unsigned order
+    static uint64_t unsigned_keys[N];
+    for (int i = 0; i < N; ++i)
+        unsigned_keys[i] = (uint64_t)random_key(&state);
+    keyed = rbt_create_u64(0);
+    ref   = rbt_create(comp_u64);
+    run(keyed, ref, (char*)unsigned_keys, sizeof(uint64_t));
+    rbt_destroy(keyed, dtor);
+    rbt_destroy(ref, dtor);
+
+    puts("test_keyed passed");
+    return 0;
+}
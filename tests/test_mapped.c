@@ -0,0 +1,191 @@
+// memory-mapped tree against a comparator tree, across reopening, plus locking, atomic creation and alignment
+#include "../src/rb_tree_mapped.c"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define OPS 200000
+#define KEYS 50000
+
+typedef struct {
+    int64_t key;
+    char    payload[20];  // not a multiple of the alignment
+} record_t;
+
+static char    dir[] = "/tmp/test_mapped.XXXXXX";
+static char    path[sizeof(dir) + 8];
+static int     keys[OPS];
+static int64_t prev;
+static size_t  visited;
+
+static int comp_record(void* a, void* b) {
+    int64_t l = ((record_t*)a)->key, r = ((record_t*)b)->key;
+    return (l > r) - (l < r);
+}
+
+static int comp_int(void* a, void* b) {
+    int l = *(int*)a, r = *(int*)b;
+    return (l > r) - (l < r);
+}
+
+static void dtor(void* value) { (void)value; }
+
+static record_t make_record(int key) {
+    record_t rec = { .key = key };
+    memset(rec.payload, (char)key, sizeof(rec.payload));
+    return rec;
+}
+
+static int check_node(rbt_mapped_tree* tree, offset_t node, size_t* count) {
+    if (node == NIL)
+        return 1;
+    mnode_t* n = AT(tree, node);
+    assert((node - FIRST_NODE) % tree->stride == 0 && node < HEADER(tree)->used);
+    assert(n->left == NIL || AT(tree, n->left)->parent == node);
+    assert(n->right == NIL || AT(tree, n->right)->parent == node);
+    assert(n->color == BLACK || (AT(tree, n->left)->color == BLACK && AT(tree, n->right)->color == BLACK));
+    assert((uintptr_t)VALUE(tree, node) % ALIGN == 0);
+    int left  = check_node(tree, n->left, count);
+    int right = check_node(tree, n->right, count);
+    assert(left == right);
+    ++*count;
+    return left + (n->color == BLACK);
+}
+
+static void visit(void* value, void* ctx) {
+    record_t*     rec = (record_t*)value;
+    rbt_iterator* it  = (rbt_iterator*)ctx;
+    assert(rec->key >= prev && rec->key == *(int*)rbt_iter_val(*it));
+    for (size_t i = 0; i < sizeof(rec->payload); ++i)
+        assert(rec->payload[i] == (char)rec->key);
+    prev = rec->key;
+    *it  = rbt_iter_next(*it);
+    ++visited;
+}
+
+// the shape is a red-black tree and the values come in the order of the reference
+static void verify(rbt_mapped_tree* tree, rbt_tree* ref) {
+    header_t* header = HEADER(tree);
+    size_t    count  = 0;
+    assert(header->nil.color == BLACK && (header->root == NIL || AT(tree, header->root)->parent == NIL));
+    assert(header->root == NIL || AT(tree, header->root)->color == BLACK);
+    check_node(tree, header->root, &count);
+    assert(count == rbt_mapped_size(tree) && count == rbt_size(ref));
+
+    rbt_iterator it = rbt_begin(ref);
+    prev            = INT64_MIN;
+    visited         = 0;
+    rbt_mapped_for_each(tree, visit, &it);
+    assert(visited == count && rbt_iter_eq(it, rbt_end(ref)));
+}
+
+static void random_ops(rbt_mapped_tree* tree, rbt_tree* ref) {
+    for (int i = 0; i < OPS; ++i) {
+        keys[i]      = rand() % KEYS;
+        record_t rec = make_record(keys[i]);
+        if (i % 3)
+            assert(rbt_mapped_insert(tree, &rec) == 0 && rbt_insert(ref, keys + i).err == 0);
+        else
+            assert(rbt_mapped_insert_unique(tree, &rec) == (int)rbt_insert_unique(ref, keys + i).err);
+        if (i % 4 == 0) {
+            int      key  = rand() % KEYS;
+            record_t gone = make_record(key);
+            assert(rbt_mapped_erase(tree, &gone) == rbt_erase(ref, &key, dtor));
+        }
+        if (i % 20000 == 0)
+            verify(tree, ref);
+    }
+    verify(tree, ref);
+}
+
+// erased nodes are reused before the file grows
+static void reuse(rbt_mapped_tree* tree) {
+    rbt_mapped_clear(tree);
+    for (int i = 0; i < 1000; ++i) {
+        record_t rec = make_record(i);
+        assert(rbt_mapped_insert(tree, &rec) == 0);
+    }
+    uint64_t used = HEADER(tree)->used, capacity = HEADER(tree)->capacity;
+    for (int round = 0; round < 10; ++round) {
+        for (int i = round; i < 1000; i += 2) {
+            record_t rec = make_record(i);
+            assert(rbt_mapped_erase(tree, &rec) == 1);
+        }
+        for (int i = round; i < 1000; i += 2) {
+            record_t rec = make_record(i);
+            assert(rbt_mapped_insert_unique(tree, &rec) == 0);
+        }
+    }
+    assert(rbt_mapped_size(tree) == 1000 && HEADER(tree)->used == used && HEADER(tree)->capacity == capacity);
+}
+
+// a second process is refused while the file is open
+static void locked(void) {
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+        _exit(rbt_open_mapped(path, comp_record, sizeof(record_t)) == NULL && errno == EBUSY ? 0 : 1);
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+// an existing file is opened only if it holds a tree, and is left untouched otherwise
+static void foreign(void) {
+    char bytes[INITIAL_CAPACITY], back[INITIAL_CAPACITY];
+    memset(bytes, 'X', sizeof(bytes));
+    memset(bytes, 0, sizeof(MAGIC));  // what an interrupted creation used to leave
+    for (size_t size = 0; size <= sizeof(bytes); size += sizeof(bytes) / 2) {
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(fd >= 0 && write(fd, bytes, size) == (ssize_t)size);
+        assert(rbt_open_mapped(path, comp_record, sizeof(record_t)) == NULL && errno == EINVAL);
+        assert(pread(fd, back, sizeof(back), 0) == (ssize_t)size && memcmp(back, bytes, size) == 0);
+        close(fd);
+    }
+    unlink(path);
+
+    // a missing file is created whole, without leaving the temporary file behind
+    rbt_mapped_tree* tree = rbt_open_mapped(path, comp_record, sizeof(record_t));
+    assert(tree && rbt_mapped_size(tree) == 0);
+    record_t rec = make_record(1);
+    assert(rbt_mapped_insert(tree, &rec) == 0 && rbt_mapped_find(tree, &rec) != NULL);
+    assert(rbt_close_mapped(tree) == 0);
+    unlink(path);
+}
+
+int main(void) {
+    assert(mkdtemp(dir) != NULL);
+    snprintf(path, sizeof(path), "%s/tree", dir);
+    srand(3);
+
+    rbt_tree*        ref  = rbt_create(comp_int);
+    rbt_mapped_tree* tree = rbt_open_mapped(path, comp_record, sizeof(record_t));
+    assert(tree && rbt_mapped_size(tree) == 0);
+    random_ops(tree, ref);
+    locked();
+    assert(rbt_sync(tree) == 0 && rbt_close_mapped(tree) == 0);
+
+    // reopening keeps the order and the size, with the same value size only
+    assert(rbt_open_mapped(path, comp_record, sizeof(record_t) + 1) == NULL && errno == EINVAL);
+    assert(rbt_open_mapped(path, comp_record, sizeof(record_t) - 1) == NULL && errno == EINVAL);
+    tree = rbt_open_mapped(path, comp_record, sizeof(record_t));
+    assert(tree);
+    verify(tree, ref);
+    for (int i = 0; i < OPS; i += 2) {
+        record_t  rec   = make_record(keys[i]);
+        record_t* found = (record_t*)rbt_mapped_find(tree, &rec);
+        assert((found != NULL) == rbt_iter_neq(rbt_find(ref, keys + i), rbt_end(ref)));
+        assert(found == NULL || (found->key == keys[i] && (uintptr_t)found % ALIGN == 0));
+        assert(rbt_mapped_erase(tree, &rec) == rbt_erase(ref, keys + i, dtor));
+    }
+    verify(tree, ref);
+
+    reuse(tree);
+    assert(rbt_close_mapped(tree) == 0);
+    rbt_destroy(ref, dtor);
+
+    foreign();
+    assert(rmdir(dir) == 0);  // nothing else was created
+    puts("test_mapped passed");
+    return 0;
+}
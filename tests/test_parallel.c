@@ -0,0 +1,112 @@
+// parallel for_each / reduce against sequential traversals, and how evenly a skewed tree is cut
+#include "../src/rb_tree.c"
+#include <stdio.h>
+
+#define N 200000
+#define SKEWED 1000000
+
+static int values[N];
+
+static int comp(void* a, void* b) {
+    int l = *(int*)a, r = *(int*)b;
+    return (l > r) - (l < r);
+}
+
+static void dtor(void* value) { (void)value; }
+
+typedef struct {  // hash of a sequence, combining two of them is associative but not commutative
+    uint64_t hash;
+    uint64_t power;
+} seq_t;
+
+#define BASE 1000003u
+
+static void fold_seq(void* acc, void* value, void* ctx) {
+    seq_t* seq = (seq_t*)acc;
+    (void)ctx;
+    seq->hash  = seq->hash * BASE + (uint64_t)*(int*)value;
+    seq->power = seq->power * BASE;
+}
+
+static void combine_seq(void* acc, void* other, void* ctx) {
+    seq_t* lhs = (seq_t*)acc;
+    seq_t* rhs = (seq_t*)other;
+    (void)ctx;
+    lhs->hash  = lhs->hash * rhs->power + rhs->hash;
+    lhs->power = lhs->power * rhs->power;
+}
+
+static void mark(void* value, void* ctx) {  // every value is visited exactly once
+    atomic_fetch_add((atomic_int*)ctx + ((int*)value - values), 1);
+}
+
+static atomic_int visits[N];
+
+static void check(rbt_tree* tree, int* lo, int* hi) {
+    seq_t        expected = { 0, 1 };
+    rbt_iterator first    = lo ? rbt_lower_bound(tree, lo) : rbt_begin(tree);
+    rbt_iterator last     = hi ? rbt_lower_bound(tree, hi) : rbt_end(tree);
+    for (rbt_iterator it = first; rbt_iter_neq(it, last); it = rbt_iter_next(it))
+        fold_seq(&expected, rbt_iter_val(it), NULL);
+
+    size_t nthreads[] = { 0, 1, 3, 8 };
+    for (size_t t = 0; t < sizeof(nthreads) / sizeof(nthreads[0]); ++t) {
+        seq_t seq = { 0, 1 };
+        assert(rbt_parallel_reduce_range(tree, lo, hi, fold_seq, combine_seq, &seq, sizeof(seq), NULL, nthreads[t]) == 0);
+        assert(seq.hash == expected.hash && seq.power == expected.power);
+
+        for (size_t i = 0; i < N; ++i)
+            atomic_init(visits + i, 0);
+        assert(rbt_parallel_for_each_range(tree, lo, hi, mark, visits, nthreads[t]) == 0);
+        for (rbt_iterator it = first; rbt_iter_neq(it, last); it = rbt_iter_next(it))
+            atomic_fetch_sub(visits + ((int*)rbt_iter_val(it) - values), 1);
+        for (size_t i = 0; i < N; ++i)
+            assert(atomic_load(visits + i) == 0);
+    }
+}
+
+static size_t count(rbt_link* node) { return IS_NIL(node) ? 0 : value_count(node) + count(node->left) + count(node->right); }
+
+// ascending insertions leave the subtrees at one depth far apart in size, no span may hold a large share
+static void skewed(void) {
+    static int ascending[SKEWED];
+    rbt_tree*  tree = rbt_create(comp);
+    for (int i = 0; i < SKEWED; ++i) {
+        ascending[i] = i;
+        rbt_insert(tree, ascending + i);
+    }
+    size_t  nthreads = 8, depth = split_depth(nthreads), n = 0, largest = 0;
+    span_t* spans    = (span_t*)malloc(sizeof(span_t) << (depth + 1));
+    split(tree, NULL, NULL, tree->root.link.parent, depth, spans, &n);
+    for (size_t i = 0; i < n; ++i) {
+        size_t size = spans[i].whole ? count(spans[i].node) : 1;
+        largest     = size > largest ? size : largest;
+    }
+    assert(largest * nthreads * 4 <= SKEWED);  // a quarter of the share of one thread at most
+    free(spans);
+    rbt_destroy(tree, dtor);
+}
+
+int main(void) {
+    srand(9);
+    for (int multi = 0; multi < 2; ++multi) {
+        rbt_tree* tree = multi ? rbt_create_multimap(comp) : rbt_create(comp);
+        seq_t     seq  = { 7, 1 };
+        assert(rbt_parallel_reduce(tree, fold_seq, combine_seq, &seq, sizeof(seq), NULL, 4) == 0);
+        assert(seq.hash == 7 && seq.power == 1);  // an empty tree leaves the identity alone
+
+        for (int i = 0; i < N; ++i) {
+            values[i] = rand() % (N / 4) - N / 8;
+            rbt_insert(tree, values + i);
+        }
+        check(tree, NULL, NULL);
+        for (int q = 0; q < 10; ++q) {
+            int lo = rand() % (N / 4) - N / 8, hi = lo + rand() % (N / 8);
+            check(tree, q % 3 ? &lo : NULL, q % 4 ? &hi : NULL);
+        }
+        rbt_destroy(tree, dtor);
+    }
+    skewed();
+    puts("test_parallel passed");
+    return 0;
+}
@@ -0,0 +1,188 @@
+// random inserts and erasures on plain and multimap trees, checked against a sorted array after every step
+#include "../src/rb_tree.c"
+#include <stdio.h>
+
+#define OPS 20000
+#define KEYS 300
+#define BUCKET 100000
+
+typedef struct {
+    int key;
+    int id;  // tells equal values apart
+} item_t;
+
+static item_t  items[OPS];
+static item_t* ref[OPS];  // the expected iteration order, equal keys in insertion order
+static size_t  ref_size;
+
+static int comp(void* a, void* b) {
+    int l = ((item_t*)a)->key, r = ((item_t*)b)->key;
+    return (l > r) - (l < r);
+}
+
+static size_t dropped;
+static void   dtor(void* value) {
+    (void)value;
+    ++dropped;
+}
+
+static int check_node(rbt_tree* tree, rbt_link* node, size_t* count) {
+    if (IS_NIL(node)) {
+        assert(node == &tree->root.link);
+        return 1;
+    }
+    assert(IS_NIL(node->left) || node->left->parent == node);
+    assert(IS_NIL(node->right) || node->right->parent == node);
+    assert(IS_BLACK(node) || (IS_BLACK(node->left) && IS_BLACK(node->right)));
+    assert((node->color & ~3ul) == tree->layout);  // rebalancing keeps the layout bits
+    for (size_t i = 1; i < value_count(node); ++i)
+        assert(comp(value_at(node, i), NODE(node)->value) == 0);
+    int left  = check_node(tree, node->left, count);
+    int right = check_node(tree, node->right, count);
+    assert(left == right);
+    *count += value_count(node);
+    return left + IS_BLACK(node);
+}
+
+static void verify(rbt_tree* tree) {
+    rbt_link* header = &tree->root.link;
+    rbt_link* root   = header->parent;
+    size_t    count  = 0;
+    assert(IS_NIL(header) && IS_BLACK(header));
+    if (IS_NIL(root))
+        assert(header->left == header && header->right == header);
+    else {
+        assert(IS_BLACK(root) && root->parent == header);
+        assert(header->left == leftmost(root) && header->right == rightmost(root));
+    }
+    check_node(tree, root, &count);
+    assert(count == ref_size && rbt_size(tree) == ref_size);
+
+    size_t i = 0;
+    for (rbt_iterator it = rbt_begin(tree); rbt_iter_neq(it, rbt_end(tree)); it = rbt_iter_next(it))
+        assert(rbt_iter_val(it) == ref[i++]);
+    assert(i == ref_size);
+    for (rbt_iterator it = rbt_rbegin(tree); rbt_iter_neq(it, rbt_rend(tree)); it = rbt_iter_next(it))
+        assert(rbt_iter_val(it) == ref[--i]);
+    assert(i == 0);
+}
+
+static rbt_iterator iter_at(rbt_tree* tree, size_t index) {
+    rbt_iterator it = rbt_begin(tree);
+    while (index-- > 0)
+        it = rbt_iter_next(it);
+    return it;
+}
+
+static void ref_remove(size_t first, size_t last) {
+    memmove(ref + first, ref + last, (ref_size - last) * sizeof(item_t*));
+    ref_size -= last - first;
+}
+
+static void expect_at(rbt_tree* tree, rbt_iterator it, size_t index) {
+    if (index == ref_size)
+        assert(rbt_iter_eq(it, rbt_end(tree)));
+    else
+        assert(rbt_iter_val(it) == ref[index]);
+}
+
+static void random_ops(rbt_tree* tree) {
+    ref_size = 0;
+    for (int n = 0; n < OPS; ++n) {
+        int op = rand() % 10;
+        if (op < 5 || ref_size == 0) {
+            item_t* item = items + n;
+            *item        = (item_t){ .key = rand() % KEYS, .id = n };
+            size_t pos   = ref_size;
+            while (pos > 0 && comp(ref[pos - 1], item) > 0)
+                --pos;
+            memmove(ref + pos + 1, ref + pos, (ref_size - pos) * sizeof(item_t*));
+            ref[pos] = item;
+            ++ref_size;
+            rbt_insert_result_t res = rbt_insert(tree, item);
+            assert(res.err == 0 && rbt_iter_val(res.pos) == item);
+        }
+        else if (op == 5) {
+            item_t key   = { .key = rand() % KEYS };
+            size_t first = 0, last;
+            while (first < ref_size && comp(ref[first], &key) < 0)
+                ++first;
+            for (last = first; last < ref_size && comp(ref[last], &key) == 0;)
+                ++last;
+            dropped = 0;
+            assert(rbt_erase(tree, &key, dtor) == last - first && dropped == last - first);
+            ref_remove(first, last);
+        }
+        else if (op == 6) {
+            size_t index = (size_t)rand() % ref_size;
+            rbt_iterator it = rbt_erase_at(tree, iter_at(tree, index), dtor);
+            ref_remove(index, index + 1);
+            expect_at(tree, it, index);
+        }
+        else if (op == 7) {
+            size_t first = (size_t)rand() % ref_size;
+            size_t last  = first + (size_t)rand() % (ref_size - first + 1) / 8;
+            dropped      = 0;
+            rbt_iterator it = rbt_erase_range(tree, iter_at(tree, first), iter_at(tree, last), dtor);
+            assert(dropped == last - first);
+            ref_remove(first, last);
+            expect_at(tree, it, first);
+        }
+        else {
+            size_t index = (size_t)rand() % ref_size;
+            assert(rbt_extract(tree, iter_at(tree, index)) == ref[index]);
+            ref_remove(index, index + 1);
+        }
+        if (n % 97 == 0)
+            verify(tree);
+    }
+    verify(tree);
+    rbt_clear(tree, dtor);
+    ref_size = 0;
+    verify(tree);
+}
+
+// erasing a slice of one big bucket must not shift the rest of it once per value
+static void bucket_slice(void) {
+    static item_t same[BUCKET];
+    rbt_tree*     tree = rbt_create_multimap(comp);
+    for (int i = 0; i < BUCKET; ++i) {
+        same[i] = (item_t){ .key = 1, .id = i };
+        rbt_insert(tree, same + i);
+    }
+    rbt_iterator first = rbt_iter_next(rbt_begin(tree));
+    rbt_iterator it    = rbt_erase_range(tree, first, rbt_iter_prev(rbt_end(tree)), dtor);
+    assert(rbt_size(tree) == 2 && rbt_iter_val(it) == same + BUCKET - 1);
+    it = rbt_erase_range(tree, rbt_begin(tree), it, dtor);  // the head goes, the last value takes its place
+    assert(rbt_size(tree) == 1 && rbt_iter_val(rbt_begin(tree)) == same + BUCKET - 1);
+    rbt_destroy(tree, dtor);
+}
+
+// assigning keeps the position of the first equal value
+static void assign_multimap(void) {
+    item_t    a = { 50, 0 }, b = { 50, 1 }, c = { 50, 2 };
+    rbt_tree* tree = rbt_create_multimap(comp);
+    rbt_insert(tree, &a);
+    rbt_insert(tree, &b);
+    rbt_insert_or_assign_result_t res = rbt_insert_or_assign(tree, &c);
+    assert(res.old == &a && rbt_iter_val(res.pos) == &c);
+    ref[0] = &c, ref[1] = &b, ref_size = 2;
+    verify(tree);
+    rbt_destroy(tree, dtor);
+}
+
+// plain trees do not pay for the buckets of multimaps
+_Static_assert(sizeof(node_t) == sizeof(rbt_link) + sizeof(void*), "plain nodes hold the links and the value only");
+
+int main(void) {
+    srand(7);
+    for (int multi = 0; multi < 2; ++multi) {
+        rbt_tree* tree = multi ? rbt_create_multimap(comp) : rbt_create(comp);
+        random_ops(tree);
+        rbt_destroy(tree, dtor);
+    }
+    bucket_slice();
+    assign_multimap();
+    puts("test_rb_tree passed");
+    return 0;
+}
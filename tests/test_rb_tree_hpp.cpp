@@ -0,0 +1,220 @@
+// rbt::tree against std::multiset, move-only values and allocators that do not propagate
+#include "rb_tree.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <type_traits>
+
+namespace {
+
+struct move_only {
+    int                  key;
+    std::unique_ptr<int> id;
+
+    move_only(int key, int id) : key(key), id(new int(id)) {}
+    move_only(move_only&&)            = default;
+    move_only& operator=(move_only&&) = default;
+
+    bool operator<(const move_only& other) const { return key < other.key; }
+};
+
+struct arena {
+    long live = 0;  // blocks handed out and not returned yet
+};
+
+template <class T>
+struct arena_allocator {
+    using value_type                             = T;
+    using propagate_on_container_move_assignment = std::false_type;
+
+    arena* owner;
+
+    explicit arena_allocator(arena* owner) : owner(owner) {}
+    template <class U>
+    arena_allocator(const arena_allocator<U>& other) : owner(other.owner) {}
+
+    T* allocate(std::size_t n) {
+        ++owner->live;
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) {
+        --owner->live;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    bool operator==(const arena_allocator<U>& other) const {
+        return owner == other.owner;
+    }
+    template <class U>
+    bool operator!=(const arena_allocator<U>& other) const {
+        return owner != other.owner;
+    }
+};
+
+template <class Tree, class Ref>
+void expect_equal(const Tree& tree, const Ref& ref) {
+    assert(tree.size() == ref.size() && tree.empty() == ref.empty());
+    assert(std::equal(tree.begin(), tree.end(), ref.begin(), ref.end()));
+    assert(std::equal(tree.rbegin(), tree.rend(), ref.rbegin(), ref.rend()));
+}
+
+void random_ops() {
+    std::mt19937       rng(7);
+    rbt::tree<int>     tree;
+    std::multiset<int> ref;
+    for (int n = 0; n < 100000; ++n) {
+        int key = static_cast<int>(rng() % 1000);
+        switch (rng() % 6) {
+        case 0:
+        case 1:
+            tree.insert(key);
+            ref.insert(key);
+            break;
+        case 2: {
+            auto res      = tree.emplace_unique(key);
+            bool inserted = ref.count(key) == 0;
+            if (inserted)
+                ref.insert(key);
+            assert(res.second == inserted && *res.first == key);
+            break;
+        }
+        case 3:
+            assert(tree.erase(key) == ref.erase(key));
+            break;
+        case 4: {
+            auto it = tree.find(key);
+            assert((it == tree.end()) == (ref.find(key) == ref.end()));
+            if (it != tree.end()) {
+                auto next = tree.erase(it);
+                ref.erase(ref.find(key));
+                assert(next == tree.upper_bound(key) || *next == key);
+            }
+            break;
+        }
+        default: {
+            int  hi   = key + static_cast<int>(rng() % 20);
+            auto last = tree.erase(tree.lower_bound(key), tree.upper_bound(hi));
+            ref.erase(ref.lower_bound(key), ref.upper_bound(hi));
+            assert(last == tree.upper_bound(hi));
+        }
+        }
+        if (n % 5000 == 0)
+            expect_equal(tree, ref);
+    }
+    expect_equal(tree, ref);
+    for (int key = 0; key < 1000; ++key) {
+        assert(tree.count(key) == ref.count(key) && tree.contains(key) == (ref.count(key) != 0));
+        auto range = tree.equal_range(key);
+        assert(std::distance(range.first, range.second) == static_cast<std::ptrdiff_t>(ref.count(key)));
+    }
+    tree.erase(tree.begin(), tree.end());
+    ref.clear();
+    expect_equal(tree, ref);
+}
+
+void copy_and_move() {
+    std::multiset<int> ref{ 5, 1, 4, 1, 3 };
+    rbt::tree<int>     tree;
+    tree.insert(ref.begin(), ref.end());
+
+    rbt::tree<int> copy(tree);
+    expect_equal(copy, ref);
+    const int*     first = &*tree.begin();
+    rbt::tree<int> moved(std::move(tree));
+    assert(&*moved.begin() == first);  // the nodes change hands
+    assert(tree.empty() && tree.begin() == tree.end() && tree.find(1) == tree.end() && tree.count(1) == 0);
+    tree.insert(2);  // a moved-from tree is usable again
+    assert(tree.size() == 1 && *tree.begin() == 2);
+
+    tree = copy;
+    expect_equal(tree, ref);
+    copy = std::move(moved);
+    expect_equal(copy, ref);
+    assert(moved.empty());
+    tree = rbt::tree<int>();
+    assert(tree.empty() && tree.begin() == tree.end());
+
+    rbt::tree<std::string, std::greater<>> desc;
+    for (const char* s : { "b", "c", "a" })
+        desc.insert(s);
+    assert(*desc.begin() == "c" && *desc.rbegin() == "a");
+
+    static_assert(std::is_nothrow_move_constructible_v<rbt::tree<int>>);
+    static_assert(std::is_nothrow_move_assignable_v<rbt::tree<int>>);
+    static_assert(std::is_nothrow_default_constructible_v<rbt::tree<int>>);
+}
+
+void move_only_values() {
+    rbt::tree<move_only> tree;
+    std::multiset<int>   ref;
+    std::mt19937         rng(3);
+    for (int n = 0; n < 2000; ++n) {
+        int key = static_cast<int>(rng() % 300);
+        if (n % 3 == 0) {
+            auto res = tree.emplace_unique(key, n);
+            assert(res.second == (ref.count(key) == 0) && res.first->key == key);
+            if (res.second)
+                ref.insert(key);
+            else
+                assert(*res.first->id != n);  // the existing value is kept
+        }
+        else {
+            auto it = tree.emplace(key, n);
+            assert(it->key == key && *it->id == n);
+            ref.insert(key);
+        }
+    }
+    move_only lo(100, 0), hi(200, 0);
+    tree.erase(tree.lower_bound(lo), tree.lower_bound(hi));
+    ref.erase(ref.lower_bound(100), ref.lower_bound(200));
+    assert(tree.size() == ref.size());
+    assert(std::equal(tree.begin(), tree.end(), ref.begin(), ref.end(),
+                      [](const move_only& lhs, int rhs) { return lhs.key == rhs; }));
+
+    rbt::tree<move_only> moved(std::move(tree));
+    tree = std::move(moved);
+    assert(tree.size() == ref.size() && moved.empty());
+}
+
+void foreign_allocators() {
+    using tree_type = rbt::tree<int, std::less<int>, arena_allocator<int>>;
+    static_assert(!std::is_nothrow_move_assignable_v<tree_type>);
+    arena a, b;
+    {
+        tree_type lhs{ std::less<int>(), arena_allocator<int>(&a) };
+        tree_type rhs{ std::less<int>(), arena_allocator<int>(&b) };
+        assert(a.live == 0);  // nothing is allocated before the first insertion
+        for (int i = 0; i < 100; ++i)
+            rhs.insert(i % 10);
+        lhs.insert(42);
+        lhs = std::move(rhs);  // unequal allocators: the values are moved into nodes of arena a
+        assert(lhs.size() == 100 && rhs.empty() && lhs.get_allocator() == arena_allocator<int>(&a));
+        assert(a.live == 101 && b.live == 1);
+        assert(std::is_sorted(lhs.begin(), lhs.end()) && lhs.count(3) == 10);
+
+        tree_type same{ std::less<int>(), arena_allocator<int>(&a) };
+        same = std::move(lhs);  // equal allocators: the nodes are taken over
+        assert(same.size() == 100 && lhs.empty() && a.live == 101);
+
+        tree_type copy(same);
+        assert(copy.size() == 100 && a.live == 202);
+    }
+    assert(a.live == 0 && b.live == 0);
+}
+
+}  // namespace
+
+int main() {
+    random_ops();
+    copy_and_move();
+    move_only_values();
+    foreign_allocators();
+    puts("test_rb_tree_hpp passed");
+    return 0;
+}